@@ -1,4 +1,7 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <math.h>
 #include <pthread.h>
 #include <stddef.h>
@@ -6,12 +9,26 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "headers/BMPHandler.h"
+#include "headers/BoundedQueue.h"
+#include "headers/Chain.h"
+#include "headers/Cheese.h"
+#include "headers/Convolve.h"
+#include "headers/Gaussian.h"
+#include "headers/Histogram.h"
 #include "headers/Image.h"
+#include "headers/Integral.h"
+#include "headers/Lut.h"
 #include "headers/macros.h"
-
-typedef void *(*filter_method)(void *);
+#include "headers/Orient.h"
+#include "headers/Partition.h"
+#include "headers/Planar.h"
+#include "headers/Resize.h"
+#include "headers/Simd.h"
+#include "headers/ThreadPool.h"
 
 /**
  * Structure to hold program options.
@@ -19,12 +36,91 @@ typedef void *(*filter_method)(void *);
 typedef struct {
   char input_filename[PATH_MAX]; /**< Input filename buffer */
   char output_filename[PATH_MAX]; /**< Output filename buffer */
-  filter_method filter_func; /**< Function pointer to the filter method */
+  FilterChain chain; /**< The filters to apply, in order */
   int rShift; /**< Red color shift value */
   int gShift; /**< Green color shift value */
   int bShift; /**< Blue color shift value */
+  size_t blur_radius; /**< Box blur radius */
+  double sigma; /**< Gaussian blur standard deviation */
+  ConvolutionKernel kernel; /**< Kernel of the convolution filter */
+  uint64_t seed; /**< Seed of the cheese filter's holes */
+  size_t resize_width; /**< Width the resize filter resamples to */
+  size_t resize_height; /**< Height the resize filter resamples to */
+  resize_method resize_method; /**< Resampling filter of the resize filter */
+  histogram_op histogram_op; /**< Tables the histogram filter derives */
+  size_t band_rows; /**< Rows per band when streaming, 0 to load the image */
+  bool huge_pages; /**< Back large pixel buffers with huge pages */
+  bool planar; /**< Filter on per-channel planes where the filter can */
+  size_t thread_count; /**< Worker threads, 0 to size the pool to the CPUs */
+  Partition partition; /**< How the image is cut into regions for threads */
+  pool_affinity affinity; /**< Where to pin the worker threads */
+  simd_level simd; /**< Widest vector kernels to use */
 } ProgramOptions;
 
+/**
+ * A pass that deinterleaves an image into planes, split into row bands.
+ */
+typedef struct {
+  const Image *image; /**< The packed image */
+  PlanarBuffer *planes; /**< The destination planes */
+  size_t parts; /**< Number of row bands the pass is split into */
+} PlanesJob;
+
+/**
+ * A pass that first-touches the pages of a pixel buffer, split into row
+ * bands.
+ */
+typedef struct {
+  const PixelBuffer *buffer; /**< The buffer to touch */
+  size_t page_size; /**< Bytes per page */
+  size_t parts; /**< Number of row bands the pass is split into */
+} TouchJob;
+
+/**
+ * A band of the image on its way through the streaming pipeline. The slot's
+ * buffers are reused for every band it carries.
+ */
+typedef struct {
+  size_t index; /**< Index of the slot */
+  Image *band_image; /**< The band plus its halo rows */
+  PlanarBuffer band_planes; /**< Planar copy of the band, planar layout only */
+  IntegralImage band_table; /**< Summed-area table of the band, box mean only */
+  GaussianImage band_blur; /**< Gaussian blur of the band, Gaussian only */
+  size_t first; /**< First image row of the band */
+  size_t rows; /**< Rows in the band, without the halo */
+  size_t top; /**< Halo rows read above the band */
+} BandSlot;
+
+/**
+ * State shared by the stages of the streaming pipeline. Slots travel from
+ * the free queue to the reader, on to the filter stage, on to the writer and
+ * back to the free queue.
+ */
+typedef struct {
+  FILE *input_file; /**< Input file, only used by the reader */
+  const BMPHeader *BMP; /**< BMP header of the input file */
+  size_t width; /**< Width of the image */
+  size_t height; /**< Height of the image */
+  size_t band_rows; /**< Rows per band */
+  size_t halo; /**< Halo rows needed above and below a band */
+  bool in_place; /**< Bands are read straight into the output image */
+  Image *output_image; /**< The mapped output file, or a band per slot */
+  int output_fd; /**< File descriptor of the pre-sized output file */
+  bool output_mapped; /**< Whether the output image is the mapped file */
+  const BMPHeader *out_BMP; /**< BMP header of the output file */
+  BoundedQueue *free_slots; /**< Slots ready for the reader */
+  BoundedQueue *read_slots; /**< Slots ready for the filter stage */
+  BoundedQueue *filtered_slots; /**< Slots ready for the writer */
+  int read_status; /**< EXIT_FAILURE once the reader failed */
+  int write_status; /**< EXIT_FAILURE once the writer failed */
+} Pipeline;
+
+/**
+ * Bands in flight at once when streaming: one being read, one being
+ * filtered and one being written.
+ */
+#define PIPELINE_DEPTH 3
+
 /**
  * Display usage information for the program.
  * @param argv Array of command-line arguments.
@@ -32,19 +128,54 @@ typedef struct {
 void display_usage(char **argv);
 
 /**
- * Initialize thread data for image processing.
+ * Initialize thread data for image processing: cut the rows filtered in a
+ * pass into regions and make one ThreadData per region.
  * @param data Pointer to the thread data array.
+ * @param job_count Pointer to the number of regions, one ThreadData each.
  * @param image Pointer to the image structure.
- * @param rShift Pointer to the red color shift value.
- * @param gShift Pointer to the green color shift value.
- * @param bShift Pointer to the blue color shift value.
+ * @param rows Number of rows filtered in a pass.
+ * @param parts Number of bands or stripes to cut the rows into: the number
+ *        of pool workers.
+ * @param og_planes Planar copy of the image, nullptr unless planar layout
+ *        is used.
+ * @param integral Summed-area table of the image, nullptr unless the box
+ *        mean filter is used.
+ * @param gaussian Gaussian blur of the image, nullptr unless the Gaussian
+ *        filter is used.
+ * @param resize Horizontally resampled image, nullptr unless the resize
+ *        filter is used.
+ * @param scratch The chain's intermediate images, created here once the
+ *        regions are known; nullptr unless the chain has several passes.
+ * @param options Pointer to the ProgramOptions structure.
+ * @param output_image The shared output image; each thread gets a view of
+ *        its columns of the first rows of it. Its width is the width cut
+ *        into regions, which only differs from the image's when resizing.
+ * @param output_fd File descriptor of the pre-sized output file, -1 if the
+ *        output image is the mapped file itself.
+ * @param out_BMP BMP header of the output file.
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
  */
 int init_thread_data(ThreadData ***data,
+                     size_t *job_count,
                      const Image *image,
-                     const int *rShift,
-                     const int *gShift,
-                     const int *bShift);
+                     size_t rows,
+                     size_t parts,
+                     PlanarBuffer *og_planes,
+                     const IntegralImage *integral,
+                     const GaussianImage *gaussian,
+                     const ResizeImage *resize,
+                     ChainScratch *scratch,
+                     const ProgramOptions *options,
+                     Image *output_image,
+                     int output_fd,
+                     const BMPHeader *out_BMP);
+
+/**
+ * Free the thread data array and every thread's planar buffers.
+ * @param data Pointer to the thread data array.
+ * @param job_count Number of entries in the thread data array.
+ */
+void free_thread_data(ThreadData ***data, size_t job_count);
 
 /**
  * Process user arguments and populate program options.
@@ -55,355 +186,1679 @@ int init_thread_data(ThreadData ***data,
 void process_user_args(int argc, char **argv, ProgramOptions *options);
 
 /**
- * Extract input image data from the input file.
+ * Extract input image data from the input file. The file is memory mapped
+ * when possible, in which case the pixel buffer is a view into the mapping;
+ * otherwise the pixels are read into the in-place target if there is one,
+ * or into a freshly allocated buffer.
+ * @param input_file Pointer to the input file, its headers already read.
+ * @param input_pixels Pointer to the input pixel buffer.
+ * @param mapping Pointer to the input file mapping (base is nullptr if the
+ *        file was not mapped).
+ * @param BMP Pointer to the BMP header structure.
+ * @param DIB Pointer to the DIB header structure.
+ * @param in_place Buffer the filter will overwrite, to read the pixels into
+ *        instead of allocating a buffer; nullptr for out-of-place filters.
+ * @param huge_pages Back an allocated pixel buffer with huge pages.
+ * @param pool The worker thread pool, to first-touch an allocated buffer.
+ */
+int extract_input_image_data(FILE *input_file,
+                             PixelBuffer *input_pixels,
+                             BMPMapping *mapping,
+                             const BMPHeader *BMP,
+                             const DIBHeader *DIB,
+                             const PixelBuffer *in_place,
+                             bool huge_pages,
+                             ThreadPool *pool);
+
+/**
+ * Read and validate the headers of the input file.
  * @param input_file Pointer to the input file.
- * @param input_pixels Pointer to the 2D array of input pixels.
  * @param BMP Pointer to the BMP header structure.
  * @param DIB Pointer to the DIB header structure.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
  */
-int extract_input_image_data(char *input_filename,
-                             Pixel ***input_pixels,
-                             BMPHeader *BMP,
-                             DIBHeader *DIB);
+int read_input_headers(FILE *input_file, BMPHeader *BMP, DIBHeader *DIB);
 
 /**
- * Write the output file with the filtered image.
- * @param output_file Pointer to the output file.
- * @param image Pointer to the image structure.
- * @param new_pixels Pointer to the 2D array of new pixels.
- * @param BMP BMP header structure.
- * @param DIB DIB header structure.
+ * Create the output file: write its headers and pre-size it so that threads
+ * can write their rows at their final offsets in any order.
+ * @param output_filename Name of the output file.
+ * @param DIB Pointer to the DIB header of the output image.
+ * @param output_fd Pointer to the output file descriptor.
+ * @param out_BMP Pointer to the BMP header of the output file.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int open_output_file(char *output_filename,
+                     const DIBHeader *DIB,
+                     int *output_fd,
+                     BMPHeader *out_BMP);
+
+/**
+ * Create the shared output image the threads filter into. When the output
+ * file can be mapped, the image is a view of its pixel array and the pixels
+ * reach the file without being copied; otherwise a buffer of the given
+ * number of rows is allocated and threads write their rows out of it.
+ * @param output_fd File descriptor of the pre-sized output file.
+ * @param out_BMP BMP header of the output file.
+ * @param DIB Pointer to the DIB header of the output image.
+ * @param rows Rows to allocate if the file cannot be mapped.
+ * @param huge_pages Back an allocated pixel buffer with huge pages.
+ * @param mapping Pointer to the output file mapping (base is nullptr if the
+ *        file was not mapped).
+ * @param output_image Pointer to the output image structure.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int init_output_image(int output_fd,
+                      const BMPHeader *out_BMP,
+                      const DIBHeader *DIB,
+                      size_t rows,
+                      bool huge_pages,
+                      BMPMapping *mapping,
+                      Image **output_image);
+
+/**
+ * Run one pass over the image: run a task per ThreadData on the pool and
+ * wait for them.
+ * @param pool The worker thread pool.
+ * @param job_data The thread data array.
+ * @param job_count Number of entries in the thread data array.
+ * @param task Task run with the thread data array as its context; it must
+ *        set the ThreadData's status.
+ * @return EXIT_SUCCESS if every task succeeded, EXIT_FAILURE otherwise.
+ */
+int run_tasks(ThreadPool *pool,
+              ThreadData **job_data,
+              size_t job_count,
+              pool_task task);
+
+/**
+ * Task: run the ThreadData's filter into its view of the output image, then
+ * write the finished rows to their place in the output file unless the
+ * output image is the mapped file.
+ * @param context The thread data array.
+ * @param index Index of the task's ThreadData.
+ */
+static void filter_task(void *context, size_t index);
+
+/**
+ * Log how well the pool's workers were kept busy, and how much idle time
+ * work stealing recovered compared with a static split of the regions.
+ * @param pool The worker thread pool.
+ */
+static void report_scheduling(const ThreadPool *pool);
+
+/**
+ * Deinterleave an image into its planar copy on the pool, ahead of a planar
+ * filter pass.
+ * @param pool The worker thread pool.
+ * @param image The packed image.
+ * @param planes The destination planes.
+ */
+static void deinterleave_image(ThreadPool *pool,
+                               const Image *image,
+                               PlanarBuffer *planes);
+
+/**
+ * First-touch an allocated pixel buffer from the pool, so that each row
+ * band's pages are placed on the NUMA node of the worker that starts with
+ * the same band of a pass. Views are left alone.
+ * @param pool The worker thread pool.
+ * @param buffer The pixel buffer.
+ */
+static void first_touch(ThreadPool *pool, const PixelBuffer *buffer);
+
+/**
+ * Task: touch every page of one row band of a TouchJob.
+ * @param context The TouchJob.
+ * @param index Index of the row band.
+ */
+static void touch_task(void *context, size_t index);
+
+/**
+ * Task: deinterleave one row band of a PlanesJob.
+ * @param context The PlanesJob.
+ * @param index Index of the row band.
+ */
+static void planes_task(void *context, size_t index);
+
+/**
+ * Parse one tone operation, <name>=<value>, into per-channel tables.
+ * @param spec The operation, ending at a comma or the end of the string.
+ * @param lut Pointer to the tables to fill.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+static int parse_tone_op(const char *spec, Lut *lut);
+
+/**
+ * Parse a comma-separated list of filters, each named by its first letter or
+ * a tone operation, or a Gaussian blur, into the options' chain.
+ * @param spec The list, e.g. "g,s,b", "gamma=2.2,contrast=1.2" or
+ * "gaussian=4".
+ * @param options Pointer to the ProgramOptions structure, whose blur radius
+ * and shifts the filters use and that receives the Gaussian's sigma.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+static int parse_filter_chain(const char *spec, ProgramOptions *options);
+
+/**
+ * Parse a resize filter, resize=<width>x<height>[:<method>], into the
+ * options.
+ * @param spec The filter, up to the next ',' or the end of the string.
+ * @param options Pointer to the ProgramOptions structure.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if spec is not a resize.
+ */
+static int parse_resize(const char *spec, ProgramOptions *options);
+
+/**
+ * Parse an orientation filter: rotate=90|180|270, flip=h|v or transpose.
+ * @param spec The filter, up to the next ',' or the end of the string.
+ * @param orient Where to store the orientation.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if spec is not one.
  */
-int write_output_file(char *output_filename,
-                      const Image *image,
-                      Pixel **new_pixels,
-                      BMPHeader BMP,
-                      DIBHeader DIB);
+static int parse_orientation(const char *spec, orientation *orient);
+
+/**
+ * Whether the filter runs on the planar layout: only a chain of a single
+ * pass with a planar variant does.
+ * @param options Pointer to the ProgramOptions structure.
+ */
+static bool use_planar(const ProgramOptions *options);
+
+/**
+ * Whether the filter reads a summed-area table of its input: only a chain
+ * of a single box mean pass does.
+ * @param options Pointer to the ProgramOptions structure.
+ */
+static bool use_integral(const ProgramOptions *options);
+
+/**
+ * Whether the filter reads a Gaussian blur of its input built beforehand:
+ * only a chain of a single Gaussian pass does.
+ * @param options Pointer to the ProgramOptions structure.
+ */
+static bool use_gaussian(const ProgramOptions *options);
+
+/**
+ * Whether the filter resizes the image: only a chain of a single resize
+ * pass does, and its output has the size given with it.
+ * @param options Pointer to the ProgramOptions structure.
+ */
+static bool use_resize(const ProgramOptions *options);
+
+/**
+ * Whether the filter remaps the image through tables derived from its
+ * histogram: only a chain of a single auto-levels or equalization pass does.
+ * @param options Pointer to the ProgramOptions structure.
+ */
+static bool use_histogram(const ProgramOptions *options);
+
+/**
+ * Whether the filter rotates, flips or transposes the image: only a chain of
+ * a single orientation pass does.
+ * @param options Pointer to the ProgramOptions structure.
+ */
+static bool use_orient(const ProgramOptions *options);
+
+/**
+ * Whether the filter chain may overwrite its input: pointwise filters only
+ * read the pixel they write. A resize or an orientation reads other pixels
+ * than it writes.
+ * @param options Pointer to the ProgramOptions structure.
+ */
+static bool use_in_place(const ProgramOptions *options);
+
+/**
+ * Draw the cheese filter's holes for the whole image, if the chain has a
+ * cheese pass, and hand them to every such pass.
+ * @param options Pointer to the ProgramOptions structure.
+ * @param DIB Pointer to the DIB header of the input image.
+ * @param holes Pointer to the holes to draw.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+static int prepare_cheese(ProgramOptions *options,
+                          const DIBHeader *DIB,
+                          CheeseHoles *holes);
+
+/**
+ * Gather the histogram of the input image on the pool, if the filter is a
+ * histogram filter, and derive the tables its pass applies from it.
+ * @param options Pointer to the ProgramOptions structure.
+ * @param input_image Pointer to the input image structure.
+ * @param pool The worker thread pool.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+static int prepare_histogram(ProgramOptions *options,
+                             const Image *input_image,
+                             ThreadPool *pool);
 
 /**
  * Perform the specified filter on the input image.
  * @param input_image Pointer to the input image structure.
  * @param filter_func Function pointer to the filter method.
  * @param job_data Pointer to the thread data array.
- * @param tids Array of thread IDs.
+ * @param pool The worker thread pool.
  */
 void do_filter(const Image *input_image,
                filter_method filter_func,
                ThreadData ***job_data,
-               pthread_t tids[THREAD_COUNT]);
-
-/**
- * Write the output pixels to the output pixel array.
- * @param output_pixels Pointer to the 2D array of output pixels.
- * @param job_data Pointer to the thread data array.
- */
-void write_output_pixels(Pixel **output_pixels,
-                         ThreadData **job_data);
+               ThreadPool *pool);
 
 /**
  * Initialize the input image from the input file.
- * @param input_file Pointer to the input file.
+ * @param input_file Pointer to the input file, its headers already read.
  * @param input_image Pointer to the input image structure.
+ * @param mapping Pointer to the input file mapping.
  * @param BMP Pointer to the BMP header structure.
  * @param DIB Pointer to the DIB header structure.
+ * @param in_place Buffer the filter will overwrite, nullptr for
+ *        out-of-place filters.
+ * @param huge_pages Back an allocated pixel buffer with huge pages.
+ * @param pool The worker thread pool, to first-touch an allocated buffer.
  */
-int init_input_image(char *input_filename,
+int init_input_image(FILE *input_file,
                      Image **input_image,
-                     BMPHeader *BMP,
-                     DIBHeader *DIB);
+                     BMPMapping *mapping,
+                     const BMPHeader *BMP,
+                     const DIBHeader *DIB,
+                     const PixelBuffer *in_place,
+                     bool huge_pages,
+                     ThreadPool *pool);
 
 /**
- * Perform the filtering process on the input image.
+ * Perform the filtering process on the input image. Each thread filters
+ * straight into the shared output image, so the output is complete once
+ * this returns.
  * @param input_image Pointer to the input image structure.
  * @param job_data Pointer to the thread data array.
- * @param tids Array of thread IDs.
+ * @param job_count Pointer to the number of regions, one ThreadData each.
+ * @param pool The worker thread pool.
  * @param options Pointer to the ProgramOptions structure.
+ * @param output_image The shared output image.
+ * @param output_fd File descriptor of the pre-sized output file, -1 if the
+ *        output image is the mapped file itself.
+ * @param out_BMP BMP header of the output file.
  */
 int perform_filtering(const Image *input_image,
                       ThreadData ***job_data,
-                      pthread_t tids[THREAD_COUNT],
-                      const ProgramOptions *options);
+                      size_t *job_count,
+                      ThreadPool *pool,
+                      const ProgramOptions *options,
+                      Image *output_image,
+                      int output_fd,
+                      const BMPHeader *out_BMP);
 
 /**
- * Clean up resources allocated during the program execution.
- * @param input_image Pointer to the input image structure.
- * @param output_image Pointer to the output image structure.
+ * Filter the input file band by band without loading the whole image. A
+ * reader thread reads the next band while the pool filters the current one
+ * and a writer thread writes the previous one, so disk and CPU work overlap;
+ * the stages hand bands over through bounded queues, so at most
+ * PIPELINE_DEPTH bands, plus the halo rows the filter's neighborhood needs,
+ * are held in memory at a time.
+ * @param input_file Pointer to the input file, positioned anywhere.
+ * @param BMP Pointer to the BMP header of the input file.
+ * @param DIB Pointer to the DIB header of the input file.
  * @param job_data Pointer to the thread data array.
+ * @param job_count Pointer to the number of regions, one ThreadData each.
+ * @param pool The worker thread pool.
+ * @param options Pointer to the ProgramOptions structure.
+ * @param output_image The shared output image: the whole mapped output
+ *        file, or one band of rows per slot.
+ * @param output_fd File descriptor of the pre-sized output file.
+ * @param output_mapped Whether the output image is the mapped file itself.
+ * @param out_BMP BMP header of the output file.
  */
-void cleanup_resources(Image *input_image,
-                       Image *output_image,
-                       ThreadData **job_data);
+int perform_streaming(FILE *input_file,
+                      const BMPHeader *BMP,
+                      const DIBHeader *DIB,
+                      ThreadData ***job_data,
+                      size_t *job_count,
+                      ThreadPool *pool,
+                      const ProgramOptions *options,
+                      Image *output_image,
+                      int output_fd,
+                      bool output_mapped,
+                      const BMPHeader *out_BMP);
+
+/**
+ * Number of pipeline slots to stream an image with: PIPELINE_DEPTH, or
+ * fewer if the image has fewer bands.
+ * @param options Pointer to the ProgramOptions structure.
+ * @param height Height of the image.
+ */
+static size_t stream_slot_count(const ProgramOptions *options, size_t height);
+
+/**
+ * Row of the output image a slot's band is filtered into.
+ * @param pipeline The pipeline.
+ * @param slot The slot.
+ */
+static size_t band_output_row(const Pipeline *pipeline, const BandSlot *slot);
+
+/**
+ * Pipeline stage: read each band, with its halo, into a free slot.
+ * @param data The Pipeline.
+ * @return nullptr.
+ */
+static void *read_stage(void *data);
 
 /**
- * Write the output image to the output file.
- * @param output_file Pointer to the output file.
+ * Pipeline stage: write each filtered band to the output file, or start
+ * writing back its pages if the output is mapped, and free its slot.
+ * @param data The Pipeline.
+ * @return nullptr.
+ */
+static void *write_stage(void *data);
+
+/**
+ * Clean up resources allocated during the program execution.
  * @param input_image Pointer to the input image structure.
  * @param job_data Pointer to the thread data array.
- * @param output_image Pointer to the output image structure.
- * @param BMP Pointer to the BMP header structure.
- * @param DIB Pointer to the DIB header structure.
+ * @param job_count Number of entries in the thread data array.
  */
-int write_output(char *output_file,
-                 const Image *input_image,
-                 ThreadData **job_data,
-                 Image **output_image,
-                 const BMPHeader *BMP,
-                 const DIBHeader *DIB);
+void cleanup_resources(Image *input_image,
+                       ThreadData **job_data,
+                       size_t job_count);
 
 int main(int argc, char *argv[]) {
   // Define program options
   ProgramOptions options = {0};
   BMPHeader BMP;
   DIBHeader DIB;
+  BMPHeader out_BMP;
+  DIBHeader out_DIB;
   FILE *input_file = nullptr;
-  FILE *output_file = nullptr;
+  int output_fd = -1;
   Image *input_image = nullptr;
   Image *output_image = nullptr;
   ThreadData **job_data = nullptr;
-  pthread_t tids[THREAD_COUNT];
+  size_t job_count = 0;
+  BMPMapping input_mapping = {0};
+  BMPMapping output_mapping = {0};
+  ThreadPool *pool = nullptr;
+  CheeseHoles holes = {0};
+  int status = EXIT_FAILURE;
 
   // Parse user arguments
   process_user_args(argc, argv, &options);
+  printf("SIMD: %s\n", simd_level_name(simd_select(options.simd)));
 
-  // Initialize input image
-  if ((init_input_image(options.input_filename,
+  // Read the headers; the pixels are read once the output image exists
+  if ((input_file = fopen(options.input_filename, "rb")) == nullptr) {
+    perror("Input file could not be opened.");
+    goto cleanup;
+  }
+  if (read_input_headers(input_file, &BMP, &DIB) != EXIT_SUCCESS) {
+    fprintf(stderr, "Error reading input image headers.\n");
+    goto cleanup;
+  }
+
+  // The output has the input's size unless it is resized
+  out_DIB = DIB;
+  if (use_resize(&options)) {
+    out_DIB.image_width_w = (int32_t) options.resize_width;
+    out_DIB.image_height_h = (int32_t) options.resize_height;
+    printf("Resize: %dx%d to %dx%d, %s\n",
+           DIB.image_width_w, DIB.image_height_h,
+           out_DIB.image_width_w, out_DIB.image_height_h,
+           resize_method_name(options.resize_method));
+  }
+  // or its axes swapped by a quarter turn or a transpose
+  if (use_orient(&options) &&
+      orientation_swaps_axes(options.chain.passes[0].orient)) {
+    out_DIB.image_width_w = DIB.image_height_h;
+    out_DIB.image_height_h = DIB.image_width_w;
+    out_DIB.x_pixels_per_meter = DIB.y_pixels_per_meter;
+    out_DIB.y_pixels_per_meter = DIB.x_pixels_per_meter;
+  }
+  if (use_orient(&options)) {
+    printf("Orientation: %s, %dx%d to %dx%d\n",
+           orientation_name(options.chain.passes[0].orient),
+           DIB.image_width_w, DIB.image_height_h,
+           out_DIB.image_width_w, out_DIB.image_height_h);
+  }
+
+  // Draw the holes once, so every region and band punches the same ones
+  if (prepare_cheese(&options, &DIB, &holes) != EXIT_SUCCESS) {
+    perror("Error creating cheese holes.");
+    goto cleanup;
+  }
+
+  // Start the workers once; every pass and band reuses them
+  if ((pool = thread_pool_create(options.thread_count > 0
+                                   ? options.thread_count
+                                   : thread_pool_default_size(),
+                                 options.affinity)) == nullptr) {
+    goto cleanup;
+  }
+
+  // Create the output file
+  if ((open_output_file(options.output_filename,
+                        &out_DIB,
+                        &output_fd,
+                        &out_BMP)) != EXIT_SUCCESS) {
+    perror("Error creating output file.");
+    goto cleanup;
+  }
+
+  // Create the shared output image; a streamed image only needs a band per
+  // pipeline slot
+  if ((init_output_image(output_fd,
+                         &out_BMP,
+                         &out_DIB,
+                         options.band_rows > 0 &&
+                         options.band_rows < (size_t) DIB.image_height_h
+                           ? options.band_rows *
+                             stream_slot_count(&options,
+                                               (size_t) DIB.image_height_h)
+                           : (size_t) out_DIB.image_height_h,
+                         options.huge_pages,
+                         &output_mapping,
+                         &output_image)) != EXIT_SUCCESS) {
+    perror("Error creating output image.");
+    goto cleanup;
+  }
+  first_touch(pool, &output_image->pixels);
+
+  // Initialize input image; streaming reads it band by band instead
+  if (options.band_rows == 0 &&
+      (init_input_image(input_file,
                         &input_image,
+                        &input_mapping,
                         &BMP,
-                        &DIB)) != EXIT_SUCCESS) {
+                        &DIB,
+                        use_in_place(&options) ? &output_image->pixels
+                                               : nullptr,
+                        options.huge_pages,
+                        pool)) != EXIT_SUCCESS) {
     perror("Error initializing input image.");
     goto cleanup;
   }
 
-  // Perform filtering
-  if ((perform_filtering(input_image, &job_data, tids, &options)) !=
-      EXIT_SUCCESS) {
+  // A histogram filter's tables need the whole image counted first
+  if (options.band_rows == 0 &&
+      prepare_histogram(&options, input_image, pool) != EXIT_SUCCESS) {
+    perror("Error gathering histogram.");
+    goto cleanup;
+  }
+
+  // Perform filtering; threads write their rows to the output as they finish
+  if (options.band_rows > 0) {
+    if ((perform_streaming(input_file,
+                           &BMP,
+                           &DIB,
+                           &job_data,
+                           &job_count,
+                           pool,
+                           &options,
+                           output_image,
+                           output_fd,
+                           output_mapping.base != nullptr,
+                           &out_BMP)) != EXIT_SUCCESS) {
+      perror("Error occurred during filtering.");
+      goto cleanup;
+    }
+  } else if ((perform_filtering(input_image,
+                                &job_data,
+                                &job_count,
+                                pool,
+                                &options,
+                                output_image,
+                                output_mapping.base ? -1 : output_fd,
+                                &out_BMP)) != EXIT_SUCCESS) {
     perror("Error occurred during filtering.");
     goto cleanup;
   }
+  report_scheduling(pool);
 
-  // Write output
-  if ((write_output(options.output_filename,
-                    input_image,
-                    job_data,
-                    &output_image,
-                    &BMP,
-                    &DIB)) != EXIT_SUCCESS) {
+  // Close output; the mapped pixels are written back by the page cache
+  image_destroy(&output_image);
+  unmapBMPFile(&output_mapping);
+  if (close(output_fd) != 0) {
+    output_fd = -1;
     perror("Error writing output image.");
     goto cleanup;
   }
-  return EXIT_SUCCESS;
+  output_fd = -1;
+  status = EXIT_SUCCESS;
 
 cleanup:
   if (input_file) fclose(input_file);
-  if (output_file) fclose(output_file);
+  if (output_fd >= 0) close(output_fd);
   if (input_image) image_destroy(&input_image);
   if (output_image) image_destroy(&output_image);
-  // Free thread data
-  if (job_data) {
-    for (int i = 0; i < THREAD_COUNT; ++i) {
-      free_pixel_array_2d(job_data[i]->thread_pixel_array,
-                          (size_t) job_data[i]->height);
-      FREE(job_data[i]);
-    }
-    FREE(job_data);
-  }
+  // the image rows may point into the mappings, so unmap after destroying them
+  unmapBMPFile(&input_mapping);
+  unmapBMPFile(&output_mapping);
+  // Free thread data and stop the workers
+  free_thread_data(&job_data, job_count);
+  thread_pool_destroy(&pool);
+  cheese_holes_destroy(&holes);
 
-  return EXIT_FAILURE;
+  return status;
 }
 
 void cleanup_resources(Image *input_image,
-                       Image *output_image,
-                       ThreadData **job_data) {
-  // Free input and output images
+                       ThreadData **job_data,
+                       size_t job_count) {
+  // Free input image
   image_destroy(&input_image);
-  image_destroy(&output_image);
 
   // Free thread data
-  for (int i = 0; i < THREAD_COUNT; ++i) {
-    free_pixel_array_2d(job_data[i]->thread_pixel_array,
-                        (size_t) job_data[i]->height);
-    FREE(job_data[i]);
-  }
-  FREE(job_data);
-}
-
-int write_output(char *output_file,
-                 const Image *input_image,
-                 ThreadData **job_data,
-                 Image **output_image,
-                 const BMPHeader *BMP,
-                 const DIBHeader *DIB) {
-  // Create output pixel array
-  Pixel **output_pixels =
-      create_pixel_array_2d((size_t) input_image->width,
-                            (size_t) input_image->height);
-  write_output_pixels(output_pixels, job_data);
-
-  // Create the output image
-  *output_image = image_create(output_pixels,
-                               input_image->width,
-                               input_image->height);
+  free_thread_data(&job_data, job_count);
+}
+
+void free_thread_data(ThreadData ***data, size_t job_count) {
+  if (!*data) return;
+  for (size_t i = 0; i < job_count; ++i) {
+    if (!(*data)[i]) continue;
+    planar_buffer_destroy(&(*data)[i]->thread_planes);
+    FREE((*data)[i]);
+  }
+  FREE(*data);
+}
+
+int read_input_headers(FILE *input_file, BMPHeader *BMP, DIBHeader *DIB) {
+  if (readBMPHeader(input_file, BMP) != EXIT_SUCCESS) {
+    fprintf(stderr, "Input file is too short for a BMP header.\n");
+    return EXIT_FAILURE;
+  }
+  if (BMP->signature[0] != 'B' || BMP->signature[1] != 'M') {
+    fprintf(stderr, "Input file is not a BMP file.\n");
+    return EXIT_FAILURE;
+  }
+  if (readDIBHeader(input_file, DIB) != EXIT_SUCCESS) {
+    fprintf(stderr, "Input file is too short for a DIB header.\n");
+    return EXIT_FAILURE;
+  }
+  if (DIB->bits_per_pixel != 24 || DIB->compression != 0 ||
+      DIB->image_width_w <= 0 || DIB->image_height_h <= 0) {
+    fprintf(stderr, "Only uncompressed 24-bit bottom-up BMPs are supported.\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int open_output_file(char *output_filename,
+                     const DIBHeader *DIB,
+                     int *output_fd,
+                     BMPHeader *out_BMP) {
+  DIBHeader out_DIB;
+
+  if ((*output_fd = open(output_filename, O_RDWR | O_CREAT | O_TRUNC, 0644))
+      < 0) {
+    perror("Output file could not be opened.");
+    return EXIT_FAILURE;
+  }
+
+  // make headers that match the padded pixel array being written
+  makeBMPHeader(out_BMP,
+                (uint32_t) DIB->image_width_w,
+                (uint32_t) DIB->image_height_h);
+  makeDIBHeader(&out_DIB, DIB->image_width_w, DIB->image_height_h);
+  out_DIB.x_pixels_per_meter = DIB->x_pixels_per_meter;
+  out_DIB.y_pixels_per_meter = DIB->y_pixels_per_meter;
+
+  // write the headers and pre-size the file; padding bytes read back as 0
+  if (writeHeaders(*output_fd, out_BMP, &out_DIB) != EXIT_SUCCESS ||
+      ftruncate(*output_fd, (off_t) out_BMP->file_size) != 0) {
+    perror("Error writing output file headers.");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int init_output_image(int output_fd,
+                      const BMPHeader *out_BMP,
+                      const DIBHeader *DIB,
+                      size_t rows,
+                      bool huge_pages,
+                      BMPMapping *mapping,
+                      Image **output_image) {
+  PixelBuffer pixels;
+
+  // filter straight into the file's pixel array if the file can be mapped
+  if (mapOutputBMPFile(output_fd, mapping) == EXIT_SUCCESS) {
+    if (mapPixels(mapping,
+                  out_BMP->offset_pixel_array,
+                  (size_t) DIB->image_width_w,
+                  (size_t) DIB->image_height_h,
+                  &pixels) != EXIT_SUCCESS) {
+      return EXIT_FAILURE;
+    }
+    rows = (size_t) DIB->image_height_h;
+  } else if (pixel_buffer_create(&pixels,
+                                 (size_t) DIB->image_width_w,
+                                 rows,
+                                 huge_pages) != EXIT_SUCCESS) {
+    perror("Error creating output pixel buffer.");
+    return EXIT_FAILURE;
+  }
+
+  *output_image = image_create(&pixels, DIB->image_width_w, (int32_t) rows);
   if (!*output_image) {
+    pixel_buffer_destroy(&pixels);
     perror("Error creating output image.");
     return EXIT_FAILURE;
   }
+  return EXIT_SUCCESS;
+}
+
+static void filter_task(void *context, size_t index) {
+  ThreadData *thread_data = ((ThreadData **) context)[index];
+
+  // a filter that fails sets the status back to EXIT_FAILURE, and its
+  // region is neither written nor reported as done
+  thread_data->status = EXIT_SUCCESS;
+  thread_data->filter_func(thread_data);
+  if (thread_data->status != EXIT_SUCCESS || thread_data->output_fd < 0) {
+    return;
+  }
+  thread_data->status = pwritePixels(thread_data->output_fd,
+                                     &thread_data->thread_pixels,
+                                     thread_data->width,
+                                     thread_data->height,
+                                     thread_data->output_offset,
+                                     thread_data->output_stride);
+}
+
+static void report_scheduling(const ThreadPool *pool) {
+  ThreadPoolStats stats;
+
+  thread_pool_get_stats(pool, &stats);
+  printf("Tasks: %zu in %zu passes, steals: %zu\n",
+         stats.tasks,
+         stats.batches,
+         stats.steals);
+  printf("Idle time: %.3f ms, with static partitioning: %.3f ms, "
+         "recovered: %.3f ms\n",
+         stats.idle_seconds * 1e3,
+         stats.static_idle_seconds * 1e3,
+         (stats.static_idle_seconds - stats.idle_seconds) * 1e3);
+}
+
+static void deinterleave_image(ThreadPool *pool,
+                               const Image *image,
+                               PlanarBuffer *planes) {
+  PlanesJob job = {
+    .image = image,
+    .planes = planes,
+    .parts = thread_pool_size(pool),
+  };
+
+  thread_pool_run(pool, planes_task, &job, job.parts);
+}
+
+static void first_touch(ThreadPool *pool, const PixelBuffer *buffer) {
+  const long page_size = sysconf(_SC_PAGESIZE);
+  TouchJob job = {
+    .buffer = buffer,
+    .page_size = page_size > 0 ? (size_t) page_size : 4096,
+    .parts = thread_pool_size(pool),
+  };
+
+  if (!buffer->owned) return;
+  thread_pool_run(pool, touch_task, &job, job.parts);
+}
+
+static void touch_task(void *context, size_t index) {
+  const TouchJob *job = (TouchJob *) context;
+  size_t first_row, rows;
+
+  partition_split(job->buffer->height, job->parts, index, &first_row, &rows);
+  if (rows == 0) return;
+
+  // one write per page is enough for the kernel to place it
+  uint8_t *begin = (uint8_t *) pixel_buffer_row(job->buffer, first_row);
+  uint8_t *end = begin + rows * job->buffer->stride;
+  *begin = 0;
+  for (uint8_t *page = begin + job->page_size -
+                       (uintptr_t) begin % job->page_size;
+       page < end;
+       page += job->page_size) {
+    *page = 0;
+  }
+}
+
+static void planes_task(void *context, size_t index) {
+  const PlanesJob *job = (PlanesJob *) context;
+  size_t first_row, rows;
+
+  // whole rows, so the pass is independent of how the filter is partitioned
+  partition_split((size_t) job->image->height, job->parts, index,
+                  &first_row, &rows);
+  image_deinterleave_rows(job->image, job->planes, first_row, rows);
+}
+
+static int parse_tone_op(const char *spec, Lut *lut) {
+  const char *value = strchr(spec, '=') + 1;
+  const size_t name_length = (size_t) (value - 1 - spec);
+  char *end;
+  double number = strtod(value, &end);
+
+  if (end == value) return EXIT_FAILURE;
+  if (name_length == strlen("brightness") &&
+      strncmp(spec, "brightness", name_length) == 0 &&
+      number >= -UCHAR_MAX && number <= UCHAR_MAX) {
+    lut_colorshift(lut, (int) number, (int) number, (int) number);
+  } else if (name_length == strlen("contrast") &&
+             strncmp(spec, "contrast", name_length) == 0 && number >= 0) {
+    lut_contrast(lut, number);
+  } else if (name_length == strlen("gamma") &&
+             strncmp(spec, "gamma", name_length) == 0 && number > 0) {
+    lut_gamma(lut, number);
+  } else if (name_length == strlen("levels") &&
+             strncmp(spec, "levels", name_length) == 0 && *end == ':') {
+    // levels=<black>:<white>
+    const char *white_value = end + 1;
+    const double white = strtod(white_value, &end);
+    if (end == white_value || number < 0 || white > UCHAR_MAX ||
+        number >= white) {
+      return EXIT_FAILURE;
+    }
+    lut_levels(lut, (int) number, (int) white);
+  } else {
+    return EXIT_FAILURE;
+  }
+  return *end == ',' || *end == '\0' ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int parse_filter_chain(const char *spec, ProgramOptions *options) {
+  FilterChain *chain = &options->chain;
+  Filter blur = FILTER_BOXBLUR;
+  Filter mean = FILTER_BOXMEAN;
+  Filter gaussian = FILTER_GAUSSIAN;
+  Filter convolve = FILTER_CONVOLVE;
+  Filter median = FILTER_MEDIAN;
+  // with tone operations in the chain, color shifts become tables too, so
+  // that they fold into the same lookups
+  const bool tones = strchr(spec, '=') != nullptr;
+
+  // the chain's halo follows the blur radius chosen at run time
+  blur.radius = options->blur_radius;
+  mean.radius = options->blur_radius;
+  convolve.radius = options->kernel.size / 2;
+  *chain = (FilterChain) {0};
+  do {
+    const char *separator = strchr(spec, ',');
+    const char *equals = strchr(spec, '=');
+    const Filter *filter;
+    orientation orient;
+    Lut lut;
+
+    if (strncmp(spec, "gaussian=", strlen("gaussian=")) == 0) {
+      // gaussian=<sigma>
+      const char *value = spec + strlen("gaussian=");
+      char *end;
+      options->sigma = strtod(value, &end);
+      if (end == value || (*end != ',' && *end != '\0') ||
+          !(options->sigma > 0 && options->sigma <= GAUSSIAN_MAX_SIGMA)) {
+        return EXIT_FAILURE;
+      }
+      gaussian.radius = gaussian_radius(options->sigma);
+      if (filter_chain_append(chain, &gaussian) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+      }
+      spec = separator;
+      continue;
+    }
+    if (strncmp(spec, "median=", strlen("median=")) == 0) {
+      // median=<radius>
+      const char *value = spec + strlen("median=");
+      char *end;
+      const unsigned long radius = strtoul(value, &end, 10);
+      if (end == value || (*end != ',' && *end != '\0') || radius == 0 ||
+          radius > MEDIAN_MAX_RADIUS) {
+        return EXIT_FAILURE;
+      }
+      median.radius = (size_t) radius;
+      if (filter_chain_append(chain, &median) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+      }
+      spec = separator;
+      continue;
+    }
+    if (strncmp(spec, "resize=", strlen("resize=")) == 0) {
+      // resize=<width>x<height>[:<method>]
+      if (parse_resize(spec + strlen("resize="), options) != EXIT_SUCCESS ||
+          filter_chain_append(chain, &FILTER_RESIZE) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+      }
+      spec = separator;
+      continue;
+    }
+    if (parse_orientation(spec, &orient) == EXIT_SUCCESS) {
+      // rotate=90|180|270, flip=h|v or transpose
+      if (filter_chain_append(chain, &FILTER_ORIENT) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+      }
+      chain->passes[chain->pass_count - 1].orient = orient;
+      spec = separator;
+      continue;
+    }
+    if (equals && (!separator || equals < separator)) {
+      if (parse_tone_op(spec, &lut) != EXIT_SUCCESS ||
+          filter_chain_append_lut(chain, &lut) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+      }
+      spec = separator;
+      continue;
+    }
+    switch (*spec) {
+      case 'b':
+        filter = &blur;
+        break;
+      case 'a':
+        options->histogram_op = HISTOGRAM_AUTOLEVELS;
+        filter = &FILTER_HISTOGRAM;
+        break;
+      case 'c':
+        filter = &FILTER_CHEESE;
+        break;
+      case 'e':
+        options->histogram_op = HISTOGRAM_EQUALIZE;
+        filter = &FILTER_HISTOGRAM;
+        break;
+      case 'g':
+        filter = &FILTER_BW;
+        break;
+      case 's':
+        if (tones) {
+          lut_colorshift(&lut, options->rShift, options->gShift,
+                         options->bShift);
+          if (filter_chain_append_lut(chain, &lut) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+          }
+          spec = separator;
+          continue;
+        }
+        filter = &FILTER_COLORSHIFT;
+        break;
+      case 'm':
+        filter = &mean;
+        break;
+      case 'k':
+        if (options->kernel.size == 0) {
+          fprintf(stderr, "No convolution kernel given.\n");
+          return EXIT_FAILURE;
+        }
+        filter = &convolve;
+        break;
+      default:
+        return EXIT_FAILURE;
+    }
+    if (filter_chain_append(chain, filter) != EXIT_SUCCESS) {
+      return EXIT_FAILURE;
+    }
+    if (filter == &convolve) {
+      chain->passes[chain->pass_count - 1].kernel = &options->kernel;
+    }
+    // the rest of a name is ignored, so "-f blur" still works
+    spec = separator;
+  } while (spec++);
+
+  // later passes read region-sized scratch images, not the input the table
+  // is built from; the sliding box blur gives them the same result
+  for (size_t i = 0; chain->pass_count > 1 && i < chain->pass_count; ++i) {
+    if (chain->passes[i].filter.apply == FILTER_BOXMEAN.apply) {
+      chain->passes[i].filter = blur;
+    }
+    // the Gaussian has no such stand-in: its blur is of the whole input
+    if (chain->passes[i].filter.apply == FILTER_GAUSSIAN.apply) {
+      fprintf(stderr, "The Gaussian blur cannot be chained.\n");
+      return EXIT_FAILURE;
+    }
+    // nor can a resize change the size of the image under later passes
+    if (chain->passes[i].filter.apply == FILTER_RESIZE.apply) {
+      fprintf(stderr, "The resize filter cannot be chained.\n");
+      return EXIT_FAILURE;
+    }
+    // a histogram filter's tables are of the input image
+    if (chain->passes[i].filter.apply == FILTER_HISTOGRAM.apply) {
+      fprintf(stderr, "The histogram filters cannot be chained.\n");
+      return EXIT_FAILURE;
+    }
+    // and an orientation may change it like a resize
+    if (chain->passes[i].filter.apply == FILTER_ORIENT.apply) {
+      fprintf(stderr, "The orientation filters cannot be chained.\n");
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+static int parse_resize(const char *spec, ProgramOptions *options) {
+  const char *method;
+  char *end;
+  unsigned long width, height;
+
+  width = strtoul(spec, &end, 10);
+  if (end == spec || *end != 'x') return EXIT_FAILURE;
+  spec = end + 1;
+  height = strtoul(spec, &end, 10);
+  if (end == spec || width == 0 || height == 0 ||
+      width > MAXIMUM_IMAGE_SIZE || height > MAXIMUM_IMAGE_SIZE) {
+    fprintf(stderr, "Resize size must be between 1x1 and %dx%d.\n",
+            MAXIMUM_IMAGE_SIZE, MAXIMUM_IMAGE_SIZE);
+    return EXIT_FAILURE;
+  }
+  options->resize_width = (size_t) width;
+  options->resize_height = (size_t) height;
+  options->resize_method = RESIZE_LANCZOS;
+  if (*end == ',' || *end == '\0') return EXIT_SUCCESS;
+  if (*end != ':') return EXIT_FAILURE;
+
+  method = end + 1;
+  for (resize_method m = RESIZE_BILINEAR; m <= RESIZE_LANCZOS; ++m) {
+    const size_t length = strlen(resize_method_name(m));
+    if (strncmp(method, resize_method_name(m), length) == 0 &&
+        (method[length] == ',' || method[length] == '\0')) {
+      options->resize_method = m;
+      return EXIT_SUCCESS;
+    }
+  }
+  return EXIT_FAILURE;
+}
+
+static int parse_orientation(const char *spec, orientation *orient) {
+  for (orientation o = ORIENT_ROTATE_90; o <= ORIENT_TRANSPOSE; ++o) {
+    const size_t length = strlen(orientation_name(o));
+    if (strncmp(spec, orientation_name(o), length) == 0 &&
+        (spec[length] == ',' || spec[length] == '\0')) {
+      *orient = o;
+      return EXIT_SUCCESS;
+    }
+  }
+  return EXIT_FAILURE;
+}
+
+static bool use_planar(const ProgramOptions *options) {
+  return options->planar && options->chain.pass_count == 1 &&
+         options->chain.passes[0].filter.apply_planar;
+}
+
+static bool use_integral(const ProgramOptions *options) {
+  return options->chain.pass_count == 1 &&
+         options->chain.passes[0].filter.apply == FILTER_BOXMEAN.apply;
+}
+
+static bool use_gaussian(const ProgramOptions *options) {
+  return options->chain.pass_count == 1 &&
+         options->chain.passes[0].filter.apply == FILTER_GAUSSIAN.apply;
+}
+
+static bool use_resize(const ProgramOptions *options) {
+  return options->chain.pass_count == 1 &&
+         options->chain.passes[0].filter.apply == FILTER_RESIZE.apply;
+}
+
+static bool use_histogram(const ProgramOptions *options) {
+  return options->chain.pass_count == 1 &&
+         options->chain.passes[0].filter.apply == FILTER_HISTOGRAM.apply;
+}
+
+static bool use_orient(const ProgramOptions *options) {
+  return options->chain.pass_count == 1 &&
+         options->chain.passes[0].filter.apply == FILTER_ORIENT.apply;
+}
+
+static bool use_in_place(const ProgramOptions *options) {
+  return options->chain.radius == 0 && !use_resize(options) &&
+         !use_orient(options);
+}
+
+static int prepare_cheese(ProgramOptions *options,
+                          const DIBHeader *DIB,
+                          CheeseHoles *holes) {
+  bool drawn = false;
+
+  for (size_t i = 0; i < options->chain.pass_count; ++i) {
+    if (options->chain.passes[i].filter.apply != FILTER_CHEESE.apply) {
+      continue;
+    }
+    if (!drawn) {
+      if (cheese_holes_create(holes,
+                              (size_t) DIB->image_width_w,
+                              (size_t) DIB->image_height_h,
+                              options->seed) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+      }
+      printf("Cheese seed: %" PRIu64 "\n", options->seed);
+      drawn = true;
+    }
+    options->chain.passes[i].holes = holes;
+  }
+  return EXIT_SUCCESS;
+}
+
+static int prepare_histogram(ProgramOptions *options,
+                             const Image *input_image,
+                             ThreadPool *pool) {
+  Histogram histogram;
 
-  // Write the output file
-  if ((write_output_file(output_file, *output_image, output_pixels, *BMP, *DIB))
-      != EXIT_SUCCESS) {
-    perror("Error writing output file.");
+  if (!use_histogram(options)) return EXIT_SUCCESS;
+  if (histogram_gather(pool, input_image, &histogram) != EXIT_SUCCESS) {
     return EXIT_FAILURE;
   }
+  histogram_lut(&histogram, options->histogram_op,
+                &options->chain.passes[0].lut);
   return EXIT_SUCCESS;
 }
 
 int perform_filtering(const Image *input_image,
                       ThreadData ***job_data,
-                      pthread_t tids[THREAD_COUNT],
-                      const ProgramOptions *options) {
+                      size_t *job_count,
+                      ThreadPool *pool,
+                      const ProgramOptions *options,
+                      Image *output_image,
+                      int output_fd,
+                      const BMPHeader *out_BMP) {
+  PlanarBuffer og_planes = {0};
+  IntegralImage og_table = {0};
+  GaussianImage og_blur = {0};
+  ResizeImage og_resize = {0};
+  ChainScratch og_scratch = {0};
+  int status = EXIT_FAILURE;
+
+  // Planar layout: the filter reads a per-channel copy of the input
+  if (use_planar(options) &&
+      planar_buffer_create(&og_planes,
+                           (size_t) input_image->width,
+                           (size_t) input_image->height,
+                           options->huge_pages) != EXIT_SUCCESS) {
+    perror("Error creating planar image.");
+    return EXIT_FAILURE;
+  }
+
+  // Box mean: every window is answered from one summed-area table
+  if (use_integral(options) &&
+      integral_image_create(&og_table,
+                            (size_t) input_image->width,
+                            (size_t) input_image->height) != EXIT_SUCCESS) {
+    perror("Error creating summed-area table.");
+    goto cleanup;
+  }
+
+  // Gaussian: the whole image is blurred on the pool before the regions
+  // are copied out
+  if (use_gaussian(options) &&
+      gaussian_image_create(&og_blur,
+                            (size_t) input_image->width,
+                            (size_t) input_image->height,
+                            options->sigma,
+                            thread_pool_size(pool)) != EXIT_SUCCESS) {
+    perror("Error creating Gaussian blur.");
+    goto cleanup;
+  }
+
+  // Resize: the weight tables are computed once, and every row is
+  // resampled to the output width on the pool before the regions take
+  // their output rows from it
+  if (use_resize(options) &&
+      resize_image_create(&og_resize,
+                          (size_t) input_image->width,
+                          (size_t) input_image->height,
+                          (size_t) output_image->width,
+                          (size_t) output_image->height,
+                          options->resize_method) != EXIT_SUCCESS) {
+    perror("Error creating resize.");
+    goto cleanup;
+  }
+
   // Initialize thread data
   if (init_thread_data(job_data,
+                       job_count,
                        input_image,
-                       &options->rShift,
-                       &options->gShift,
-                       &options->bShift) != EXIT_SUCCESS) {
+                       (size_t) output_image->height,
+                       thread_pool_size(pool),
+                       use_planar(options) ? &og_planes : nullptr,
+                       use_integral(options) ? &og_table : nullptr,
+                       use_gaussian(options) ? &og_blur : nullptr,
+                       use_resize(options) ? &og_resize : nullptr,
+                       options->chain.pass_count > 1 ? &og_scratch : nullptr,
+                       options,
+                       output_image,
+                       output_fd,
+                       out_BMP) != EXIT_SUCCESS) {
     perror("Error initializing thread info.");
-    return EXIT_FAILURE;
+    goto cleanup;
   }
 
-  // Perform filtering
-  for (int i = 0; i < THREAD_COUNT; ++i) {
-    if (pthread_create(&tids[i],
+  if (use_planar(options)) {
+    deinterleave_image(pool, input_image, &og_planes);
+  }
+  if (use_integral(options)) {
+    integral_image_build(pool, input_image, &og_table);
+  }
+  if (use_gaussian(options)) {
+    gaussian_image_build(pool, input_image, &og_blur);
+  }
+  if (use_resize(options)) {
+    resize_image_build(pool, input_image, &og_resize);
+  }
+  status = run_tasks(pool, *job_data, *job_count, filter_task);
+
+cleanup:
+  planar_buffer_destroy(&og_planes);
+  integral_image_destroy(&og_table);
+  gaussian_image_destroy(&og_blur);
+  resize_image_destroy(&og_resize);
+  chain_scratch_destroy(&og_scratch);
+  return status;
+}
+
+int perform_streaming(FILE *input_file,
+                      const BMPHeader *BMP,
+                      const DIBHeader *DIB,
+                      ThreadData ***job_data,
+                      size_t *job_count,
+                      ThreadPool *pool,
+                      const ProgramOptions *options,
+                      Image *output_image,
+                      int output_fd,
+                      bool output_mapped,
+                      const BMPHeader *out_BMP) {
+  const size_t width = (size_t) DIB->image_width_w;
+  const size_t height = (size_t) DIB->image_height_h;
+  const size_t band_rows = options->band_rows < height
+                             ? options->band_rows
+                             : height;
+  const size_t halo = options->chain.radius;
+  const size_t capacity = band_rows + 2 * halo < height
+                            ? band_rows + 2 * halo
+                            : height;
+  BandSlot slots[PIPELINE_DEPTH] = {0};
+  ChainScratch band_scratch = {0};
+  const size_t slot_count = stream_slot_count(options, height);
+  Pipeline pipeline = {
+    .input_file = input_file,
+    .BMP = BMP,
+    .width = width,
+    .height = height,
+    .band_rows = band_rows,
+    .halo = halo,
+    .in_place = use_in_place(options),
+    .output_image = output_image,
+    .output_fd = output_fd,
+    .output_mapped = output_mapped,
+    .out_BMP = out_BMP,
+    .read_status = EXIT_SUCCESS,
+    .write_status = EXIT_SUCCESS,
+  };
+  pthread_t reader, writer;
+  bool reader_started = false, writer_started = false;
+  BandSlot *slot;
+  size_t filtered_rows = 0;
+  int status = EXIT_FAILURE;
+
+  // Every slot holds one band plus the halo above and below it. In-place
+  // filters have no halo, so a band is read straight into the output image.
+  for (size_t i = 0; i < slot_count; ++i) {
+    PixelBuffer band_pixels;
+    slots[i].index = i;
+    if (pipeline.in_place) {
+      band_pixels = pixel_buffer_view(output_image->pixels.data,
+                                      output_image->pixels.stride,
+                                      width,
+                                      capacity);
+    } else if (pixel_buffer_create(&band_pixels,
+                                   width,
+                                   capacity,
+                                   options->huge_pages) != EXIT_SUCCESS) {
+      perror("Error creating band pixel buffer.");
+      goto cleanup;
+    }
+    first_touch(pool, &band_pixels);
+    if ((slots[i].band_image = image_create(&band_pixels,
+                                            (int32_t) width,
+                                            (int32_t) capacity)) == nullptr) {
+      pixel_buffer_destroy(&band_pixels);
+      goto cleanup;
+    }
+    if (use_planar(options) &&
+        planar_buffer_create(&slots[i].band_planes,
+                             width,
+                             capacity,
+                             options->huge_pages) != EXIT_SUCCESS) {
+      perror("Error creating planar band.");
+      goto cleanup;
+    }
+    if (use_integral(options) &&
+        integral_image_create(&slots[i].band_table,
+                              width,
+                              capacity) != EXIT_SUCCESS) {
+      perror("Error creating summed-area table.");
+      goto cleanup;
+    }
+    if (use_gaussian(options) &&
+        gaussian_image_create(&slots[i].band_blur,
+                              width,
+                              capacity,
+                              options->sigma,
+                              thread_pool_size(pool)) != EXIT_SUCCESS) {
+      perror("Error creating Gaussian blur.");
+      goto cleanup;
+    }
+  }
+
+  // Workers only filter; the write stage writes the finished bands
+  if (init_thread_data(job_data,
+                       job_count,
+                       slots[0].band_image,
+                       band_rows,
+                       thread_pool_size(pool),
+                       use_planar(options) ? &slots[0].band_planes : nullptr,
+                       use_integral(options) ? &slots[0].band_table : nullptr,
+                       use_gaussian(options) ? &slots[0].band_blur : nullptr,
                        nullptr,
-                       options->filter_func,
-                       (*job_data)[i]) !=
+                       options->chain.pass_count > 1 ? &band_scratch : nullptr,
+                       options,
+                       output_image,
+                       -1,
+                       out_BMP) != EXIT_SUCCESS) {
+    perror("Error initializing thread info.");
+    goto cleanup;
+  }
+
+  // The queues hold every slot at most, so only the free slots bound the
+  // stages: the reader waits for one once PIPELINE_DEPTH bands are in flight
+  if ((pipeline.free_slots = bounded_queue_create(slot_count)) == nullptr ||
+      (pipeline.read_slots = bounded_queue_create(slot_count)) == nullptr ||
+      (pipeline.filtered_slots = bounded_queue_create(slot_count)) ==
+      nullptr) {
+    goto cleanup;
+  }
+  for (size_t i = 0; i < slot_count; ++i) {
+    bounded_queue_push(pipeline.free_slots, &slots[i]);
+  }
+  if (pthread_create(&reader, nullptr, read_stage, &pipeline) != 0) {
+    perror("Error creating thread.");
+    goto cleanup;
+  }
+  reader_started = true;
+  if (pthread_create(&writer, nullptr, write_stage, &pipeline) != 0) {
+    perror("Error creating thread.");
+    goto cleanup;
+  }
+  writer_started = true;
+
+  // Filter stage: filter each band as soon as it has been read
+  while ((slot = bounded_queue_pop(pipeline.read_slots)) != nullptr) {
+    const size_t out_row = band_output_row(&pipeline, slot);
+
+    for (size_t i = 0; i < *job_count; ++i) {
+      ThreadData *thread_data = (*job_data)[i];
+      const size_t region_row = thread_data->region.row;
+      // regions were cut for a full band; clip them to a short last band
+      const size_t region_rows = region_row >= slot->rows
+                                   ? 0
+                                   : thread_data->region.height <
+                                     slot->rows - region_row
+                                       ? thread_data->region.height
+                                       : slot->rows - region_row;
+      thread_data->og_image = slot->band_image;
+      if (thread_data->og_planes) {
+        thread_data->og_planes = &slot->band_planes;
+      }
+      if (thread_data->integral) {
+        thread_data->integral = &slot->band_table;
+      }
+      if (thread_data->gaussian) {
+        thread_data->gaussian = &slot->band_blur;
+      }
+      thread_data->row_start = slot->top + region_row;
+      thread_data->origin_row = slot->first - slot->top;
+      thread_data->height = region_rows;
+      thread_data->thread_pixels.data =
+          pixel_buffer_row(&output_image->pixels, out_row + region_row) +
+          thread_data->start;
+    }
+
+    if (use_planar(options)) {
+      deinterleave_image(pool, slot->band_image, &slot->band_planes);
+    }
+    if (use_integral(options)) {
+      integral_image_build(pool, slot->band_image, &slot->band_table);
+    }
+    if (use_gaussian(options)) {
+      gaussian_image_build(pool, slot->band_image, &slot->band_blur);
+    }
+    if (run_tasks(pool, *job_data, *job_count, filter_task) != EXIT_SUCCESS) {
+      break;
+    }
+    // the slot belongs to the writer once it is pushed
+    const size_t rows = slot->rows;
+    if (!bounded_queue_push(pipeline.filtered_slots, slot)) break;
+    filtered_rows += rows;
+  }
+  status = filtered_rows == height ? EXIT_SUCCESS : EXIT_FAILURE;
+
+cleanup:
+  // on failure, closing every queue stops the other stages wherever they are
+  if (status != EXIT_SUCCESS) {
+    if (pipeline.free_slots) bounded_queue_close(pipeline.free_slots);
+    if (pipeline.read_slots) bounded_queue_close(pipeline.read_slots);
+  }
+  if (pipeline.filtered_slots) bounded_queue_close(pipeline.filtered_slots);
+  if (reader_started) pthread_join(reader, nullptr);
+  if (writer_started) pthread_join(writer, nullptr);
+  if (reader_started && pipeline.read_status != EXIT_SUCCESS) {
+    status = EXIT_FAILURE;
+  }
+  if (writer_started && pipeline.write_status != EXIT_SUCCESS) {
+    status = EXIT_FAILURE;
+  }
+  bounded_queue_destroy(&pipeline.free_slots);
+  bounded_queue_destroy(&pipeline.read_slots);
+  bounded_queue_destroy(&pipeline.filtered_slots);
+  for (size_t i = 0; i < slot_count; ++i) {
+    if (slots[i].band_image) image_destroy(&slots[i].band_image);
+    planar_buffer_destroy(&slots[i].band_planes);
+    integral_image_destroy(&slots[i].band_table);
+    gaussian_image_destroy(&slots[i].band_blur);
+  }
+  chain_scratch_destroy(&band_scratch);
+  return status;
+}
+
+static size_t stream_slot_count(const ProgramOptions *options, size_t height) {
+  const size_t bands = (height + options->band_rows - 1) / options->band_rows;
+  return bands < PIPELINE_DEPTH ? bands : PIPELINE_DEPTH;
+}
+
+static size_t band_output_row(const Pipeline *pipeline, const BandSlot *slot) {
+  // a mapped output image holds every row, a buffered one a band per slot
+  return pipeline->output_mapped ? slot->first
+                                 : slot->index * pipeline->band_rows;
+}
+
+static void *read_stage(void *data) {
+  Pipeline *pipeline = (Pipeline *) data;
+  const size_t in_stride = bmpRowStride(pipeline->width);
+  const size_t halo = pipeline->halo;
+  BandSlot *slot;
+
+  for (size_t first = 0; first < pipeline->height;
+       first += pipeline->band_rows) {
+    if ((slot = bounded_queue_pop(pipeline->free_slots)) == nullptr) break;
+
+    slot->first = first;
+    slot->rows = pipeline->height - first < pipeline->band_rows
+                   ? pipeline->height - first
+                   : pipeline->band_rows;
+    // halo rows are clipped at the image edges, just like the neighborhood
+    slot->top = first < halo ? first : halo;
+    const size_t below = pipeline->height - first - slot->rows;
+    const size_t bottom = below < halo ? below : halo;
+    const size_t band_height = slot->top + slot->rows + bottom;
+
+    if (pipeline->in_place) {
+      slot->band_image->pixels.data =
+          pixel_buffer_row(&pipeline->output_image->pixels,
+                           band_output_row(pipeline, slot));
+    }
+
+    // Read the band and its halo; the band image only covers these rows, so
+    // the filter sees the image edges exactly where the real image has them
+    if (readPixels(pipeline->input_file,
+                   &slot->band_image->pixels,
+                   pipeline->width,
+                   band_height,
+                   pipeline->BMP->offset_pixel_array +
+                   (uint32_t) ((first - slot->top) * in_stride)) !=
         EXIT_SUCCESS) {
-      perror("Error creating thread.");
-      return EXIT_FAILURE;
+      perror("Error reading input band.");
+      pipeline->read_status = EXIT_FAILURE;
+      // stop the filter stage and the writer; no band after this one is whole
+      bounded_queue_close(pipeline->read_slots);
+      bounded_queue_close(pipeline->filtered_slots);
+      break;
     }
+    slot->band_image->height = (int32_t) band_height;
+    slot->band_image->pixels.height = band_height;
+
+    if (!bounded_queue_push(pipeline->read_slots, slot)) break;
+  }
+  bounded_queue_close(pipeline->read_slots);
+  return nullptr;
+}
+
+static void *write_stage(void *data) {
+  Pipeline *pipeline = (Pipeline *) data;
+  const size_t out_stride = bmpRowStride(pipeline->width);
+  BandSlot *slot;
+
+  while ((slot = bounded_queue_pop(pipeline->filtered_slots)) != nullptr) {
+    const off_t offset = (off_t) (pipeline->out_BMP->offset_pixel_array +
+                                  slot->first * out_stride);
+    int status;
+
+    if (pipeline->output_mapped) {
+      // the band is in the page cache already; start writing it back now
+      status = flushPixels(pipeline->output_fd,
+                           offset,
+                           slot->rows * out_stride);
+    } else {
+      const PixelBuffer band = pixel_buffer_view(
+          pixel_buffer_row(&pipeline->output_image->pixels,
+                           band_output_row(pipeline, slot)),
+          pipeline->output_image->pixels.stride,
+          pipeline->width,
+          slot->rows);
+      status = writePixels(pipeline->output_fd,
+                           &band,
+                           pipeline->width,
+                           slot->rows,
+                           offset);
+    }
+    if (status != EXIT_SUCCESS) {
+      perror("Error writing output band.");
+      pipeline->write_status = EXIT_FAILURE;
+      // stop the reader; the filter stage fails to hand over its next band
+      bounded_queue_close(pipeline->free_slots);
+      bounded_queue_close(pipeline->filtered_slots);
+      break;
+    }
+    bounded_queue_push(pipeline->free_slots, slot);
+  }
+  return nullptr;
+}
+
+int run_tasks(ThreadPool *pool,
+              ThreadData **job_data,
+              size_t job_count,
+              pool_task task) {
+  // Perform filtering
+  for (size_t i = 0; i < job_count; ++i) {
+    job_data[i]->status = EXIT_FAILURE;
   }
+  thread_pool_run(pool, task, job_data, job_count);
 
-  // Wait for threads to finish
-  for (int i = 0; i < THREAD_COUNT; ++i) {
-    if (pthread_join(tids[i], nullptr) != EXIT_SUCCESS) {
-      perror("Error joining thread.");
+  // Check that every task succeeded
+  for (size_t i = 0; i < job_count; ++i) {
+    if (job_data[i]->status != EXIT_SUCCESS) {
       return EXIT_FAILURE;
     }
   }
   return EXIT_SUCCESS;
 }
 
-int init_input_image(char *input_filename,
+int init_input_image(FILE *input_file,
                      Image **input_image,
-                     BMPHeader *BMP,
-                     DIBHeader *DIB) {
-  Pixel **pixels = nullptr;
+                     BMPMapping *mapping,
+                     const BMPHeader *BMP,
+                     const DIBHeader *DIB,
+                     const PixelBuffer *in_place,
+                     bool huge_pages,
+                     ThreadPool *pool) {
+  PixelBuffer pixels;
 
   // Extract input pixels
-  if (extract_input_image_data(input_filename, &pixels, BMP, DIB) !=
-      EXIT_SUCCESS) {
+  if (extract_input_image_data(input_file,
+                               &pixels,
+                               mapping,
+                               BMP,
+                               DIB,
+                               in_place,
+                               huge_pages,
+                               pool) != EXIT_SUCCESS) {
     perror("Error extracting input image data.");
     return EXIT_FAILURE;
   }
 
-  // Create input image
-  *input_image = image_create(pixels, DIB->image_width_w, DIB->image_height_h);
+  // Create input image; a mapped or in-place buffer is a view owned elsewhere
+  *input_image = image_create(&pixels, DIB->image_width_w, DIB->image_height_h);
   if (!*input_image) {
+    pixel_buffer_destroy(&pixels);
     perror("Error creating input image.");
     return EXIT_FAILURE;
   }
   return EXIT_SUCCESS;
 }
 
-void write_output_pixels(Pixel **output_pixels,
-                         ThreadData **job_data) {
-  // Copy thread pixel arrays to output pixel array
-  for (size_t i = 0; i < THREAD_COUNT; ++i) {
-    for (size_t row = 0; row < job_data[i]->height; ++row) {
-      for (size_t col = job_data[i]->start; col <= job_data[i]->end; ++col) {
-        output_pixels[row][col] =
-            job_data[i]->thread_pixel_array[row][col - job_data[i]->start];
-      }
-    }
-  }
-}
-
 int init_thread_data(ThreadData ***data,
+                     size_t *job_count,
                      const Image *image,
-                     const int32_t *rShift,
-                     const int32_t *gShift,
-                     const int32_t *bShift) {
+                     size_t rows,
+                     size_t parts,
+                     PlanarBuffer *og_planes,
+                     const IntegralImage *integral,
+                     const GaussianImage *gaussian,
+                     const ResizeImage *resize,
+                     ChainScratch *scratch,
+                     const ProgramOptions *options,
+                     Image *output_image,
+                     int output_fd,
+                     const BMPHeader *out_BMP) {
+  Region *regions = nullptr;
+
+  // Cut the filtered rows into regions, one per ThreadData
+  if (partition_image(&options->partition,
+                      (size_t) output_image->width,
+                      rows,
+                      parts,
+                      &regions,
+                      job_count) != EXIT_SUCCESS) {
+    perror("Error while partitioning the image.");
+    return EXIT_FAILURE;
+  }
+
   // Allocate memory for thread_data pointers
-  if ((*data = malloc(sizeof(ThreadData *) * THREAD_COUNT)) ==
+  if ((*data = calloc(*job_count, sizeof(ThreadData *))) ==
       nullptr) {
     perror("Error while allocating memory for thread_info pointers.");
-    return EXIT_FAILURE;
+    goto fail;
   }
 
-  // Calculate width distribution among threads
-  const int32_t width_per_thread = image->width / THREAD_COUNT;
-  const int32_t remaining_width = image->width % THREAD_COUNT;
-
   // Log for debugging
-  printf("Thread count: %d\n", THREAD_COUNT);
-  printf("Width per thread: %d, remainder: %d\n",
-         width_per_thread,
-         remaining_width);
+  printf("Thread count: %zu\n", parts);
+  printf("Region count: %zu, first region: %zux%zu\n",
+         *job_count,
+         regions[0].width,
+         regions[0].height);
 
-  for (size_t i = 0; i < THREAD_COUNT; ++i) {
+  for (size_t i = 0; i < *job_count; ++i) {
     // Allocate individual thread_data structure
-    if (((*data)[i] = malloc(sizeof(ThreadData))) == nullptr) {
+    if (((*data)[i] = calloc(1, sizeof(ThreadData))) == nullptr) {
       perror("Error while allocating memory for thread_info struct.");
-      return EXIT_FAILURE;
+      goto fail;
     }
 
     // Set basic thread properties
-    (*data)[i]->height = (size_t) image->height;
+    (*data)[i]->region = regions[i];
     (*data)[i]->og_image = image;
-    (*data)[i]->rShift = *rShift;
-    (*data)[i]->gShift = *gShift;
-    (*data)[i]->bShift = *bShift;
+    (*data)[i]->og_planes = og_planes;
+    (*data)[i]->integral = integral;
+    (*data)[i]->gaussian = gaussian;
+    (*data)[i]->resize = resize;
+    (*data)[i]->rShift = options->rShift;
+    (*data)[i]->gShift = options->gShift;
+    (*data)[i]->bShift = options->bShift;
+    (*data)[i]->blur_radius = options->blur_radius;
+    (*data)[i]->filter_func =
+        og_planes ? options->chain.passes[0].filter.apply_planar
+                  : filter_chain_method(&options->chain);
+    (*data)[i]->chain = &options->chain;
+    (*data)[i]->pass = &options->chain.passes[0];
+    (*data)[i]->scratch = scratch;
+    (*data)[i]->output_fd = output_fd;
+    (*data)[i]->output_stride = bmpRowStride((size_t) output_image->width);
+    (*data)[i]->status = EXIT_FAILURE;
 
-    // Calculate thread's section boundaries
-    if (i == 0) {
-      (*data)[i]->start = 0;
-    } else {
-      (*data)[i]->start = (*data)[i - 1]->end + 1;
-    }
+    // Region boundaries; a streamed pass moves row_start to its band
+    (*data)[i]->row_start = regions[i].row;
+    (*data)[i]->height = regions[i].height;
+    (*data)[i]->start = regions[i].col;
+    (*data)[i]->end = regions[i].col + regions[i].width - 1;
+    (*data)[i]->width = regions[i].width;
 
-    if (i == THREAD_COUNT - 1) {
-      // Last thread gets any remaining columns
-      (*data)[i]->end = (size_t) image->width - 1;
-    } else {
-      (*data)[i]->end = (*data)[i]->start + (size_t)
-                        width_per_thread - 1;
-    }
+    // Where the region's first pixel lands in the file
+    (*data)[i]->output_offset =
+        (off_t) (out_BMP->offset_pixel_array +
+                 regions[i].row * (*data)[i]->output_stride +
+                 sizeof(Pixel) * regions[i].col);
 
-    // Calculate thread's width
-    (*data)[i]->width =
-        (*data)[i]->end - (*data)[i]->start + 1;
+    // The thread filters into its region of the shared output image
+    (*data)[i]->thread_pixels =
+        pixel_buffer_view(pixel_buffer_row(&output_image->pixels,
+                                           regions[i].row) +
+                          regions[i].col,
+                          output_image->pixels.stride,
+                          regions[i].width,
+                          regions[i].height);
 
-    // Allocate memory for thread pixel array
-    if (((*data)[i]->thread_pixel_array = create_pixel_array_2d(
-           (*data)[i]->width,
-           (*data)[i]->height)) == nullptr) {
-      perror("Error while allocating memory for thread_info pixel array.");
-      return EXIT_FAILURE;
+    // Planar filters produce one row of planes at a time
+    if (og_planes &&
+        planar_buffer_create(&(*data)[i]->thread_planes,
+                             (*data)[i]->width,
+                             1,
+                             false) != EXIT_SUCCESS) {
+      perror("Error while allocating memory for thread_info planes.");
+      goto fail;
     }
 
-    // Log for debugging
-    printf("Thread %-3zu: start: %-3zu, end: %-3zu, width: %-3zu\n",
-           i,
-           (*data)[i]->start,
-           (*data)[i]->end,
-           (*data)[i]->width);
   }
+
+  // A chain of passes filters a region a strip at a time through scratch
+  // buffers of the worker running it, big enough for the widest region and
+  // tallest strip grown by the chain's halo; the last pass writes the output
+  if (scratch) {
+    const size_t halo = 2 * options->chain.radius;
+    size_t scratch_width = 0, scratch_height = 0;
+    for (size_t i = 0; i < *job_count; ++i) {
+      const size_t strip = regions[i].height < CHAIN_STRIP_ROWS
+                             ? regions[i].height
+                             : CHAIN_STRIP_ROWS;
+      const size_t width = regions[i].width + halo < (size_t) image->width
+                             ? regions[i].width + halo
+                             : (size_t) image->width;
+      const size_t height = strip + halo < (size_t) image->height
+                              ? strip + halo
+                              : (size_t) image->height;
+      if (width > scratch_width) scratch_width = width;
+      if (height > scratch_height) scratch_height = height;
+    }
+    if (chain_scratch_create(scratch, &options->chain, parts, scratch_width,
+                             scratch_height) != EXIT_SUCCESS) {
+      perror("Error while allocating memory for thread_info scratch.");
+      goto fail;
+    }
+  }
+  FREE(regions);
   return EXIT_SUCCESS;
+
+fail:
+  FREE(regions);
+  return EXIT_FAILURE;
 }
 
 void process_user_args(int argc, char **argv, ProgramOptions *options) {
   int opt;
-  while ((opt = getopt(argc, argv, "i:o:f:r:g:b:")) != -1) {
+  const char *filter_spec = nullptr;
+
+  options->blur_radius = FILTER_BOXBLUR.radius;
+  options->simd = SIMD_AVX512;
+  options->seed = (uint64_t) time(nullptr);
+  while ((opt = getopt(argc, argv, "i:o:f:r:g:b:k:K:E:R:S:HPj:t:a:x:")) != -1) {
     // if (argc != 6 + 1) {
     //   fprintf(stderr, "Expected 6 arguments, got %d instead.\n", argc - 1);
     //   display_usage(argv);
@@ -423,24 +1878,7 @@ void process_user_args(int argc, char **argv, ProgramOptions *options) {
                  optarg);
         break;
       case 'f':
-        switch (optarg[0]) {
-          case 'b':
-            options->filter_func = image_apply_t_boxblur;
-            break;
-          case 'c':
-            options->filter_func = image_apply_t_cheese;
-            break;
-          case 'g':
-            options->filter_func = image_apply_t_bw;
-            break;
-          case 's':
-            options->filter_func = image_apply_t_colorshift;
-            break;
-          default:
-            fprintf(stderr, "Invalid filter type: %s\n", optarg);
-            display_usage(argv);
-            exit(EXIT_FAILURE);
-        }
+        filter_spec = optarg;
         break;
       case 'r':
         options->rShift = atoi(optarg);
@@ -451,86 +1889,213 @@ void process_user_args(int argc, char **argv, ProgramOptions *options) {
       case 'b':
         options->bShift = atoi(optarg);
         break;
+      case 'k':
+        if (atoi(optarg) <= 0 || atoi(optarg) > BOXBLUR_MAX_RADIUS) {
+          fprintf(stderr, "Blur radius must be between 1 and %d: %s\n",
+                  BOXBLUR_MAX_RADIUS, optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        options->blur_radius = (size_t) atoi(optarg);
+        break;
+      case 'K':
+        if (convolution_kernel_parse(optarg, &options->kernel) !=
+            EXIT_SUCCESS) {
+          fprintf(stderr, "Invalid convolution kernel: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'R': {
+        char *end;
+        errno = 0;
+        options->seed = strtoull(optarg, &end, 0);
+        if (end == optarg || *end != '\0' || errno != 0) {
+          fprintf(stderr, "Invalid seed: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'E': {
+        bool found = false;
+        for (border_mode border = BORDER_CLAMP; border <= BORDER_RENORMALIZE;
+             ++border) {
+          if (strcmp(optarg, border_mode_name(border)) == 0) {
+            options->kernel.border = border;
+            found = true;
+          }
+        }
+        if (!found) {
+          fprintf(stderr, "Invalid border mode: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'S':
+        if (atoi(optarg) <= 0) {
+          fprintf(stderr, "Band rows must be positive: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        options->band_rows = (size_t) atoi(optarg);
+        break;
+      case 'H':
+        options->huge_pages = true;
+        break;
+      case 'P':
+        options->planar = true;
+        break;
+      case 'j':
+        if (atoi(optarg) <= 0) {
+          fprintf(stderr, "Thread count must be positive: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        options->thread_count = (size_t) atoi(optarg);
+        break;
+      case 't': {
+        int tile_width, tile_height;
+        char extra;
+        if (strcmp(optarg, "r") == 0) {
+          options->partition.mode = PARTITION_ROWS;
+        } else if (strcmp(optarg, "c") == 0) {
+          options->partition.mode = PARTITION_COLUMNS;
+        } else if (sscanf(optarg, "%dx%d%c", &tile_width, &tile_height,
+                          &extra) == 2 && tile_width > 0 && tile_height > 0) {
+          options->partition.mode = PARTITION_TILES;
+          options->partition.tile_width = (size_t) tile_width;
+          options->partition.tile_height = (size_t) tile_height;
+        } else {
+          fprintf(stderr, "Invalid partitioning: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'a':
+        if (strcmp(optarg, "cores") == 0) {
+          options->affinity = POOL_AFFINITY_CORES;
+        } else if (strcmp(optarg, "nodes") == 0) {
+          options->affinity = POOL_AFFINITY_NODES;
+        } else {
+          fprintf(stderr, "Invalid affinity: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'x': {
+        bool found = false;
+        for (simd_level level = SIMD_SCALAR; level <= SIMD_AVX512; ++level) {
+          if (strcmp(optarg, simd_level_name(level)) == 0) {
+            options->simd = level;
+            found = true;
+          }
+        }
+        if (!found) {
+          fprintf(stderr, "Invalid SIMD level: %s\n", optarg);
+          display_usage(argv);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
       default:
         fprintf(stderr, "Invalid option: %c\n", opt);
         display_usage(argv);
         exit(EXIT_FAILURE);
     }
   }
+  // the chain is built last, once the blur radius and shifts are known
+  if (!filter_spec) {
+    fprintf(stderr, "No filter given.\n");
+    display_usage(argv);
+    exit(EXIT_FAILURE);
+  }
+  if (parse_filter_chain(filter_spec, options) != EXIT_SUCCESS) {
+    fprintf(stderr, "Invalid filter type: %s\n", filter_spec);
+    display_usage(argv);
+    exit(EXIT_FAILURE);
+  }
+  // a band's output rows come from input rows outside it
+  if (use_resize(options) && options->band_rows > 0) {
+    fprintf(stderr, "The resize filter cannot be streamed.\n");
+    display_usage(argv);
+    exit(EXIT_FAILURE);
+  }
+  // the first band's tables depend on the last band's pixels
+  if (use_histogram(options) && options->band_rows > 0) {
+    fprintf(stderr, "The histogram filters cannot be streamed.\n");
+    display_usage(argv);
+    exit(EXIT_FAILURE);
+  }
+  // an orientation reads input rows from all over the image
+  if (use_orient(options) && options->band_rows > 0) {
+    fprintf(stderr, "The orientation filters cannot be streamed.\n");
+    display_usage(argv);
+    exit(EXIT_FAILURE);
+  }
 }
 
-int extract_input_image_data(char *input_filename,
-                             Pixel ***input_pixels,
-                             BMPHeader *BMP,
-                             DIBHeader *DIB) {
-  FILE *input_file = nullptr;
-
-  input_file = fopen(input_filename, "rb");
-  if (!input_file) {
-    perror("Input file could not be opened.");
-    return EXIT_FAILURE;
+int extract_input_image_data(FILE *input_file,
+                             PixelBuffer *input_pixels,
+                             BMPMapping *mapping,
+                             const BMPHeader *BMP,
+                             const DIBHeader *DIB,
+                             const PixelBuffer *in_place,
+                             bool huge_pages,
+                             ThreadPool *pool) {
+  // use the pixel array in place if the file can be mapped; filtering the
+  // mapping into the output is already a single pass, so in-place is moot
+  if (mapBMPFile(input_file, mapping) == EXIT_SUCCESS) {
+    if (mapPixels(mapping,
+                  BMP->offset_pixel_array,
+                  (size_t) DIB->image_width_w,
+                  (size_t) DIB->image_height_h,
+                  input_pixels) != EXIT_SUCCESS) {
+      unmapBMPFile(mapping);
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
   }
 
-  // read headers from input file
-  readBMPHeader(input_file, BMP);
-  readDIBHeader(input_file, DIB);
-
-  // allocate memory for input pixel array
-  *input_pixels = create_pixel_array_2d((size_t) DIB->image_width_w,
-                                        (size_t) DIB->image_height_h);
-  if (!*input_pixels) {
-    perror("Error creating pixel array.");
+  if (in_place) {
+    // read straight into the buffer the filter will overwrite
+    *input_pixels = pixel_buffer_view(in_place->data,
+                                      in_place->stride,
+                                      (size_t) DIB->image_width_w,
+                                      (size_t) DIB->image_height_h);
+  } else if (pixel_buffer_create(input_pixels,
+                                 (size_t) DIB->image_width_w,
+                                 (size_t) DIB->image_height_h,
+                                 huge_pages) != EXIT_SUCCESS) {
+    // allocate memory for input pixel buffer
+    perror("Error creating pixel buffer.");
     return EXIT_FAILURE;
   }
+  first_touch(pool, input_pixels);
 
   // read pixels from input file
-  readPixels(input_file,
-             *input_pixels,
-             (size_t) DIB->image_width_w,
-             (size_t) DIB->image_height_h);
-
-  // close input file
-  if (input_file) fclose(input_file);
-  return EXIT_SUCCESS;
-}
-
-/**
- * Write the output file with the filtered image.
- * @param output_file the output file to write to
- * @param image the image to write to the output file
- * @param new_pixels the new pixels to write to the output file
- * @param BMP the BMP header for the output image
- * @param DIB the DIB header for the output image
- */
-int write_output_file(char *output_filename,
-                      const Image *image,
-                      Pixel **new_pixels,
-                      const BMPHeader BMP,
-                      const DIBHeader DIB) {
-  FILE *output_file = nullptr;
-
-  if ((output_file = fopen(output_filename, "wb")) == nullptr) {
-    perror("Output file could not be opened.");
+  if (readPixels(input_file,
+                 input_pixels,
+                 (size_t) DIB->image_width_w,
+                 (size_t) DIB->image_height_h,
+                 BMP->offset_pixel_array) != EXIT_SUCCESS) {
+    fprintf(stderr, "Pixel array could not be read from the input file.\n");
+    if (!in_place) pixel_buffer_destroy(input_pixels);
     return EXIT_FAILURE;
   }
-
-  // write headers to output file
-  writeBMPHeader(output_file, &BMP);
-  writeDIBHeader(output_file, &DIB);
-
-  // write pixels to output file
-  writePixels(output_file,
-              (const Pixel * const *) new_pixels,
-              (size_t) image_get_width(image),
-              (size_t) image_get_height(image));
-
-  // close output file
-  if (output_file) fclose(output_file);
   return EXIT_SUCCESS;
 }
 
 void display_usage(char **argv) {
   fprintf(stderr,
-          "Usage: %s -i <input file> -o <output file> -f <filter>\n",
+          "Usage: %s -i <input file> -o <output file> -f <filter>[,<filter>...] "
+          "[-r <red shift>] [-g <green shift>] [-b <blue shift>] [-k <blur radius>] "
+          "[-K <kernel>|@<kernel file>] [-E clamp|mirror|zero|renormalize] [-R <seed>] "
+          "[-S <band rows>] [-H] [-P] [-j <threads>] [-t r|c|<w>x<h>] [-a cores|nodes] "
+          "[-x scalar|sse4.1|avx2|avx512]\n"
+          "A filter may be resize=<width>x<height>[:bilinear|bicubic|lanczos], "
+          "rotate=90|180|270, flip=h|v or transpose.\n",
           argv[0]);
 }
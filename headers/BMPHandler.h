@@ -1,4 +1,6 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 #include "Image.h"
 
 typedef struct {
@@ -16,13 +18,28 @@ typedef struct {
   uint32_t color_table_colors, important_color_count;
 } DIBHeader;
 
+typedef struct {
+  uint8_t *base; // start of the mapped file
+  size_t length; // length of the mapping in bytes
+} BMPMapping;
+
+/**
+ * Size in bytes of one row of 24-bit pixels, including the padding that
+ * aligns every row to 4 bytes.
+ *
+ * @param  width: Width of the image in pixels
+ * @return The padded row size in bytes
+ */
+size_t bmpRowStride(size_t width);
+
 /**
  * Read BMP header of a BMP file.
  *
  * @param  file: A pointer to the file being read
  * @param  header: Pointer to the destination BMP header
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file ends early.
  */
-void readBMPHeader(FILE *file, BMPHeader *header);
+int readBMPHeader(FILE *file, BMPHeader *header);
 
 /**
  * Write BMP header of a file. Useful for creating a BMP file.
@@ -37,8 +54,9 @@ void writeBMPHeader(FILE *file, const BMPHeader *header);
  *
  * @param  file: A pointer to the file being read
  * @param  header: Pointer to the destination DIB header
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file ends early.
  */
-void readDIBHeader(FILE *file, DIBHeader *header);
+int readDIBHeader(FILE *file, DIBHeader *header);
 
 /**
  * Write DIB header of a file. Useful for creating a BMP file.
@@ -48,6 +66,16 @@ void readDIBHeader(FILE *file, DIBHeader *header);
  */
 void writeDIBHeader(FILE *file, const DIBHeader *header);
 
+/**
+ * Write the BMP and DIB headers to the start of a file with a single write.
+ *
+ * @param  fd: File descriptor of the file being written
+ * @param  bmp: The BMP header to write
+ * @param  dib: The DIB header to write
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int writeHeaders(int fd, const BMPHeader *bmp, const DIBHeader *dib);
+
 /**
  * Make BMP header based on width and height. Useful for creating a BMP file.
  *
@@ -70,18 +98,98 @@ void makeDIBHeader(DIBHeader *header, int32_t width, int32_t height);
  * Read Pixels from BMP file based on width and height.
  *
  * @param  file: A pointer to the file being read
- * @param  pArr: Pixel array to store the pixels being read
+ * @param  pBuf: Pixel buffer to store the pixels being read
+ * @param  width: Width of the pixel array of this image
+ * @param  height: Height of the pixel array of this image
+ * @param  offset: Offset of the pixel array in the file
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file ends early or
+ *         cannot be read; the rows not read are then cleared to black.
+ */
+int readPixels(FILE *file, const PixelBuffer *pBuf, size_t width, size_t height,
+               uint32_t offset);
+
+/**
+ * Write a block of pixel rows at its final position in a BMP file with
+ * positional writes. The file position is not used, so several threads may
+ * write disjoint blocks of the same file concurrently.
+ *
+ * @param  fd: File descriptor of the file being written
+ * @param  pBuf: Pixel buffer holding the block to write
+ * @param  width: Width of the block in pixels
+ * @param  height: Height of the block in pixels
+ * @param  offset: File offset of the block's first pixel
+ * @param  stride: Bytes between consecutive rows in the file
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int pwritePixels(int fd, const PixelBuffer *pBuf, size_t width, size_t height,
+                 off_t offset, size_t stride);
+
+/**
+ * Map a BMP file into memory (private, copy-on-write) so that its pixel array
+ * can be used in place.
+ *
+ * @param  file: A pointer to the file to map
+ * @param  mapping: Pointer to the destination mapping
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int mapBMPFile(FILE *file, BMPMapping *mapping);
+
+/**
+ * Map a pre-sized output file into memory (shared) so that its pixel array
+ * can be written in place. The file's blocks are reserved first, so running
+ * out of space fails here instead of faulting while pixels are stored.
+ *
+ * @param  fd: File descriptor of the output file, opened for reading and
+ *         writing
+ * @param  mapping: Pointer to the destination mapping
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int mapOutputBMPFile(int fd, BMPMapping *mapping);
+
+/**
+ * Start writing back a block of a file written through a shared mapping,
+ * without waiting for it.
+ *
+ * @param  fd: File descriptor of the mapped file
+ * @param  offset: File offset of the block
+ * @param  length: Length of the block in bytes
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int flushPixels(int fd, off_t offset, size_t length);
+
+/**
+ * Make a pixel buffer view straight onto the pixel array of a mapped BMP file.
+ * No pixel data is copied; the view's stride is the padded BMP row size.
+ *
+ * @param  mapping: The mapped BMP file
+ * @param  offset: Offset of the pixel array in the file
  * @param  width: Width of the pixel array of this image
  * @param  height: Height of the pixel array of this image
+ * @param  pBuf: Pointer to the destination pixel buffer view
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file is too short.
+ */
+int mapPixels(const BMPMapping *mapping, uint32_t offset, size_t width,
+              size_t height, PixelBuffer *pBuf);
+
+/**
+ * Unmap a BMP file mapped by mapBMPFile or mapOutputBMPFile. Safe to call on
+ * an unused mapping.
+ *
+ * @param  mapping: The mapping to release
  */
-void readPixels(FILE *file, Pixel **pArr, size_t width, size_t height);
+void unmapBMPFile(BMPMapping *mapping);
 
 /**
- * Write Pixels from BMP file based on width and height.
+ * Write Pixels to a BMP file based on width and height. Whole padded rows are
+ * gathered straight from the pixel array and written with a few large
+ * vectored writes.
  *
- * @param  file: A pointer to the file being read or written
- * @param  pArr: Pixel array of the image to write to the file
+ * @param  fd: File descriptor of the file being written
+ * @param  pBuf: Pixel buffer of the image to write to the file
  * @param  width: Width of the pixel array of this image
  * @param  height: Height of the pixel array of this image
+ * @param  offset: Offset of the pixel array in the file
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
  */
-void writePixels(FILE *file, const Pixel * const *pArr, size_t width, size_t height);
+int writePixels(int fd, const PixelBuffer *pBuf, size_t width, size_t height,
+                off_t offset);
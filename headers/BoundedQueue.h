@@ -0,0 +1,46 @@
+#ifndef THREADEDIMAGEPROCESSOR_BOUNDEDQUEUE_H
+#define THREADEDIMAGEPROCESSOR_BOUNDEDQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct BoundedQueue BoundedQueue;
+
+/** Creates an empty first-in first-out queue of pointers that holds at most
+ * capacity items. It is safe to use from any number of threads.
+ *
+ * @param  capacity: the maximum number of items, at least 1.
+ * @return the queue, or nullptr on failure.
+ */
+BoundedQueue *bounded_queue_create(size_t capacity);
+
+/** Appends an item, waiting while the queue is full.
+ *
+ * @param  queue: the queue.
+ * @param  item: the item to append.
+ * @return false if the queue was closed and the item was not appended.
+ */
+bool bounded_queue_push(BoundedQueue *queue, void *item);
+
+/** Removes the oldest item, waiting while the queue is empty.
+ *
+ * @param  queue: the queue.
+ * @return the item, or nullptr once the queue is closed and empty.
+ */
+void *bounded_queue_pop(BoundedQueue *queue);
+
+/** Closes the queue: pushes fail from now on, and pops fail once the items
+ * already queued are taken. Wakes every waiting thread.
+ *
+ * @param  queue: the queue.
+ */
+void bounded_queue_close(BoundedQueue *queue);
+
+/** Frees a queue no thread is using any more. Safe to call on a nullptr
+ * queue.
+ *
+ * @param  queue: pointer to the queue to destroy.
+ */
+void bounded_queue_destroy(BoundedQueue **queue);
+
+#endif //THREADEDIMAGEPROCESSOR_BOUNDEDQUEUE_H
@@ -0,0 +1,74 @@
+#ifndef THREADEDIMAGEPROCESSOR_CHAIN_H
+#define THREADEDIMAGEPROCESSOR_CHAIN_H
+
+#include "Image.h"
+
+// rows of a region run through a chain's passes at a time
+#define CHAIN_STRIP_ROWS 64
+
+/** Appends a filter to a chain. A pointwise filter that follows another one
+ * joins its pass, so the run is applied in a single per-pixel loop; any other
+ * filter starts a pass of its own.
+ *
+ * @param  chain: the chain, zero-initialized before the first filter.
+ * @param  filter: the filter to append.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the chain is full.
+ */
+int filter_chain_append(FilterChain *chain, const Filter *filter);
+
+/** Appends a set of per-channel tables to a chain. Tables that follow other
+ * tables are composed with them into one set at setup time, so a run of tone
+ * operations costs a single lookup per channel; otherwise they join the
+ * pointwise run before them, or start a pass of FILTER_LUT.
+ *
+ * @param  chain: the chain, zero-initialized before the first filter.
+ * @param  lut: the tables to append.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the chain is full.
+ */
+int filter_chain_append_lut(FilterChain *chain, const Lut *lut);
+
+/** Returns the kernel a thread runs for a chain: the pass's own kernel if
+ * the chain is a single pass, otherwise image_apply_t_chain.
+ *
+ * @param  chain: the chain.
+ */
+filter_method filter_chain_method(const FilterChain *chain);
+
+/** Allocates a chain's intermediate images: for each pool worker, one buffer
+ * per pass but the last, two at most, of width x height pixels.
+ *
+ * @param  scratch: the scratch images to create.
+ * @param  chain: the chain.
+ * @param  workers: number of pool workers.
+ * @param  width: width of the largest region grown by the chain's halo.
+ * @param  height: height of the tallest strip of a region, at most
+ *         CHAIN_STRIP_ROWS, grown by the chain's halo.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int chain_scratch_create(ChainScratch *scratch, const FilterChain *chain,
+                         size_t workers, size_t width, size_t height);
+
+/** Frees a chain's intermediate images. Safe to call on a zeroed one.
+ *
+ * @param  scratch: the scratch images to free.
+ */
+void chain_scratch_destroy(ChainScratch *scratch);
+
+/** Runs every pass of the thread's chain over the thread's region, one after
+ * the other, CHAIN_STRIP_ROWS rows at a time. Each pass but the last writes
+ * to the running worker's scratch buffers, covering the strip grown by the
+ * halo the passes after it still need, so the intermediate images are only
+ * ever strip-sized, and there are only as many of them as workers.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_chain(void *data);
+
+/** Applies a fused run of pointwise filters, the thread's pass's pixel_ops,
+ * to each pixel of the thread's region in turn.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_pointwise(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_CHAIN_H
@@ -0,0 +1,45 @@
+#ifndef THREADEDIMAGEPROCESSOR_CHEESE_H
+#define THREADEDIMAGEPROCESSOR_CHEESE_H
+
+#include "Image.h"
+
+/** Draws the holes of the cheese filter for an image: 8% of its smaller
+ * dimension many, centered anywhere in it, each with a radius of at least 5
+ * and below a sixth of the smaller dimension plus 5. The same seed and size
+ * always give the same holes.
+ *
+ * @param  holes: the holes to initialize.
+ * @param  width: Width of the image in pixels.
+ * @param  height: Height of the image in pixels.
+ * @param  seed: the seed of the random generator.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int cheese_holes_create(CheeseHoles *holes, size_t width, size_t height,
+                        uint64_t seed);
+
+/** Frees the holes. Safe to call on zeroed holes.
+ *
+ * @param  holes: the holes to free.
+ */
+void cheese_holes_destroy(CheeseHoles *holes);
+
+/** Blackens the pixels of a block of the image that lie in a hole. Each hole
+ * is filled a row span at a time, clipped to the block, so the block can be
+ * any region, tile or band of the image.
+ *
+ * @param  holes: the holes.
+ * @param  pixels: the block.
+ * @param  row: the image row of the block's first row.
+ * @param  col: the image column of the block's first column.
+ */
+void cheese_holes_paint(const CheeseHoles *holes, const PixelBuffer *pixels,
+                        size_t row, size_t col);
+
+/** Cheese filter: copies the thread's region and punches its pass's holes
+ * into it.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_cheese(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_CHEESE_H
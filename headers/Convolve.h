@@ -0,0 +1,32 @@
+#ifndef THREADEDIMAGEPROCESSOR_CONVOLVE_H
+#define THREADEDIMAGEPROCESSOR_CONVOLVE_H
+
+#include "Image.h"
+
+/** Reads a convolution kernel: its weights row by row, separated by commas
+ * or white space, optionally followed by /<divisor>, e.g. "1,2,1,2,4,2,1,2,1/16".
+ * The number of weights must be the square of an odd side of at most
+ * CONVOLUTION_MAX_SIZE. The border mode is left alone.
+ *
+ * @param  spec: the kernel, or @<file> for a file that holds one.
+ * @param  kernel: the kernel to fill in.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if spec is not a kernel.
+ */
+int convolution_kernel_parse(const char *spec, ConvolutionKernel *kernel);
+
+/** Returns the name of a border mode, as accepted on the command line.
+ *
+ * @param  border: the border mode.
+ */
+const char *border_mode_name(border_mode border);
+
+/** Convolves the thread's region with its pass's kernel. Pixels whose window
+ * lies inside the image run a loop without bounds checks, unrolled for 3x3,
+ * 5x5 and 7x7 kernels; only those near the edges map each tap through the
+ * kernel's border mode.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_convolve(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_CONVOLVE_H
@@ -0,0 +1,52 @@
+#ifndef THREADEDIMAGEPROCESSOR_GAUSSIAN_H
+#define THREADEDIMAGEPROCESSOR_GAUSSIAN_H
+
+#include "Image.h"
+#include "ThreadPool.h"
+
+/** Returns the rows and columns around a pixel that its Gaussian blur
+ * reads: the sum of the box passes' radii.
+ *
+ * @param  sigma: the standard deviation of the Gaussian in pixels.
+ */
+size_t gaussian_radius(double sigma);
+
+/** Allocates an unbuilt Gaussian blur for images of up to width x height
+ * pixels, picking the box passes whose sum of variances matches sigma.
+ *
+ * @param  blur: the blur to initialize.
+ * @param  width: Width of the images in pixels.
+ * @param  height: Largest height of the images in pixels.
+ * @param  sigma: the standard deviation of the Gaussian in pixels.
+ * @param  parts: number of tasks each build pass is split into.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int gaussian_image_create(GaussianImage *blur, size_t width, size_t height,
+                          double sigma, size_t parts);
+
+/** Frees a Gaussian blur. Safe to call on a zeroed blur.
+ *
+ * @param  blur: the blur to free.
+ */
+void gaussian_image_destroy(GaussianImage *blur);
+
+/** Blurs an image on the pool: one pass runs the box passes along each row
+ * band's rows and writes them transposed, a tile of rows at a time; a second
+ * runs them down each column stripe, now contiguous. Every pixel costs the
+ * same whatever sigma is.
+ *
+ * @param  pool: the worker thread pool.
+ * @param  image: the image, no larger than the blur was created for.
+ * @param  blur: the blur to build.
+ */
+void gaussian_image_build(ThreadPool *pool, const Image *image,
+                          GaussianImage *blur);
+
+/** Gaussian blur that copies the thread's region out of the thread's built
+ * blur, transposing it back a tile of rows at a time.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_gaussian(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_GAUSSIAN_H
@@ -0,0 +1,39 @@
+#ifndef THREADEDIMAGEPROCESSOR_HISTOGRAM_H
+#define THREADEDIMAGEPROCESSOR_HISTOGRAM_H
+
+#include "Image.h"
+#include "ThreadPool.h"
+
+/** Counts the values of every channel over an image. Each task counts a band
+ * of rows into a histogram of its own; the histograms are then added up in
+ * pairs, a round of the pool per level of the tree, so no two tasks ever
+ * write the same histogram and none needs a lock.
+ *
+ * @param  pool: the worker thread pool.
+ * @param  image: the image.
+ * @param  histogram: where to store the counts.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int histogram_gather(ThreadPool *pool, const Image *image,
+                     Histogram *histogram);
+
+/** Fills the tables a histogram filter applies, channel by channel.
+ * Auto-levels maps the darkest and brightest values, ignoring the 0.5% of
+ * pixels at either end, to 0 and 255 with lut_levels. Equalization maps each
+ * value to its share of the pixels at or below it, scaled to 0..255, the
+ * smallest value present to 0. A channel of a single value is left alone.
+ *
+ * @param  histogram: the image's histogram.
+ * @param  op: the tables to derive.
+ * @param  lut: the tables to fill in.
+ */
+void histogram_lut(const Histogram *histogram, histogram_op op, Lut *lut);
+
+/** Histogram filter: maps each pixel of the thread's region through its
+ * pass's tables, derived from the whole image's histogram beforehand.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_histogram(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_HISTOGRAM_H
@@ -1,63 +1,329 @@
 ﻿#ifndef PixelProcessor_H
 #define PixelProcessor_H
 
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+
+#include "Partition.h"
 
 #define BMP_HEADER_SIZE 14
 #define BMP_DIB_HEADER_SIZE 40
 #define MAXIMUM_IMAGE_SIZE 4096
-#define KERNEL_SIZE 5  // NxN kernel size for box blur. Must be odd to be square
-#define THREAD_COUNT 12
+#define KERNEL_SIZE 5  // default NxN kernel size for box blur. Must be odd
+// largest box blur radius: keeps a (2r+1)^2 window sum of 8-bit values within
+// 32 bits
+#define BOXBLUR_MAX_RADIUS 1024
+#define PIXEL_BUFFER_ALIGNMENT 64 // cache line size; rows start on a boundary
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define FILTER_CHAIN_MAX 8 // filters in a chain given on the command line
+#define GAUSSIAN_BOXES 3 // box passes per direction approximating a Gaussian
+#define GAUSSIAN_MAX_SIGMA 1024 // largest Gaussian blur sigma in pixels
+#define CONVOLUTION_MAX_SIZE 15 // largest side of a convolution kernel; odd
+#define MEDIAN_MAX_RADIUS 1024 // largest median filter radius in pixels
 
 typedef unsigned char rgb_value;
 
+// Channels are stored in BMP on-disk order (BGR) so that a row of pixels in a
+// BMP file can be used as a Pixel row in place.
 typedef struct {
-  rgb_value r; // 8-bit rvalue
-  rgb_value g; // 8-bit gvalue
   rgb_value b; // 8-bit bvalue
+  rgb_value g; // 8-bit gvalue
+  rgb_value r; // 8-bit rvalue
 } Pixel;
 
+static_assert(sizeof(Pixel) == 3, "Pixel must match the 24-bit BMP layout");
+
+// The grayscale value of a color: 0.299 r + 0.587 g + 0.114 b, rounded down.
+// Computed in integers so that every kernel, scalar or vector, agrees on it.
+static inline rgb_value pixel_gray(rgb_value r, rgb_value g, rgb_value b) {
+  return (rgb_value) ((299u * r + 587u * g + 114u * b) / 1000u);
+}
+
+// A 2D block of pixels stored in a single allocation. Row i starts stride
+// bytes after row i - 1, so a buffer can also be a view into memory owned
+// elsewhere (e.g. a memory mapped BMP file, whose rows are padded).
+typedef struct {
+  Pixel *data; // first pixel of row 0
+  size_t stride; // bytes between the starts of consecutive rows
+  size_t width, height;
+  bool owned; // false for views; only owned buffers are freed
+} PixelBuffer;
+
+// Planar (structure of arrays) pixel storage: one plane of bytes per channel,
+// so per-channel loops run over unit-stride arrays. The three planes share a
+// single allocation that starts at r.
+typedef struct {
+  rgb_value *r, *g, *b; // first byte of row 0 of each plane
+  size_t stride; // bytes between the starts of consecutive rows of a plane
+  size_t width, height;
+} PlanarBuffer;
+
+// Summed-area table of an image: entry (y, x) holds, per channel in b, g, r
+// order, the sum of the pixels above and to the left of pixel (y, x), so it
+// has one more row and column than the image and any rectangle sums in O(1).
+// Entries are 32 bits wide unless the image's total could overflow them.
+typedef struct {
+  void *sums; // uint32_t or uint64_t entries, 3 per position
+  bool wide; // 64-bit entries
+  size_t width, height; // size of the image the table was last built from
+  size_t stride; // entries per table row: 3 * (width + 1)
+} IntegralImage;
+
+// Gaussian blur of an image before it is written out: GAUSSIAN_BOXES box
+// passes along the rows, then as many down the columns. It is stored
+// transposed, so image column x is a contiguous line of pixels and the column
+// passes run along memory. Values are 8.8 fixed point in b, g, r order, so
+// the passes do not round to 8 bits.
+typedef struct {
+  uint16_t *columns; // column x starts at columns + x * stride
+  size_t width, height; // size of the image the blur was last built from
+  size_t stride; // values between the starts of consecutive columns
+  size_t radii[GAUSSIAN_BOXES]; // radius of each box pass
+  uint16_t *scratch; // working lines of each build task
+  size_t scratch_size; // values of scratch per task
+  size_t parts; // number of tasks a build pass is split into
+} GaussianImage;
+
+// What a convolution reads for the taps of its kernel that fall outside the
+// image.
+typedef enum {
+  BORDER_CLAMP, // the nearest edge pixel
+  BORDER_MIRROR, // the pixel mirrored across the edge pixel
+  BORDER_ZERO, // black
+  BORDER_RENORMALIZE, // nothing: the in-bounds weights are scaled up so they
+                      // add up to the kernel's total
+} border_mode;
+
+// A square convolution kernel with odd sides, centered on the pixel it
+// produces. Weights are row-major with the kernel's divisor applied.
+typedef struct {
+  float weights[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  size_t size; // side in pixels
+  float total; // sum of the weights
+  border_mode border;
+} ConvolutionKernel;
+
+// A hole of the cheese filter: the pixels within radius of its center.
+typedef struct {
+  size_t row, col; // the center, in the whole image
+  size_t radius;
+} CheeseHole;
+
+// The holes of the cheese filter, drawn once per image from a seeded random
+// generator so that every region, band and thread count punches the same
+// ones. Sorted by their top row.
+typedef struct {
+  CheeseHole *holes;
+  size_t count;
+} CheeseHoles;
+
+typedef enum {
+  RESIZE_BILINEAR, // triangle filter, 2x2 pixels when enlarging
+  RESIZE_BICUBIC, // Keys cubic with a = -0.5, 4x4 pixels when enlarging
+  RESIZE_LANCZOS, // 3-lobed Lanczos, 6x6 pixels when enlarging
+} resize_method;
+
+// How a resize samples one axis: output position i is the weighted sum of
+// count[i] input positions from first[i] on, with the weights at
+// weights + i * taps in fixed point (RESAMPLE_SHIFT fraction bits).
+typedef struct {
+  size_t *first;
+  size_t *count;
+  int32_t *weights;
+  size_t taps; // weights stored per output position: the largest count
+} ResizeAxis;
+
+// Resize of an image to another size, done as two separable passes. The
+// horizontal pass is run over the whole input beforehand; the regions of the
+// output then run the vertical pass over its rows.
 typedef struct {
-  Pixel **pixel_array;
+  ResizeAxis columns; // the horizontal pass: output columns from input ones
+  ResizeAxis rows; // the vertical pass: output rows from input ones
+  PixelBuffer horizontal; // the input rows resampled to the output width
+} ResizeImage;
+
+// How the orientation filter moves the pixels, as the image is viewed.
+typedef enum {
+  ORIENT_ROTATE_90, // a quarter turn clockwise
+  ORIENT_ROTATE_180, // a half turn
+  ORIENT_ROTATE_270, // a quarter turn counterclockwise
+  ORIENT_FLIP_HORIZONTAL, // mirrored left to right
+  ORIENT_FLIP_VERTICAL, // mirrored top to bottom
+  ORIENT_TRANSPOSE, // mirrored across the top-left to bottom-right diagonal
+} orientation;
+
+typedef struct {
+  PixelBuffer pixels;
   int32_t width;
   int32_t height;
 } Image;
 
+typedef void *(*filter_method)(void *);
+
+typedef struct ThreadData ThreadData;
+
+// a pointwise filter applied to a single pixel
+typedef Pixel (*pixel_method)(Pixel pixel, const ThreadData *data);
+
 typedef struct {
-  Pixel **thread_pixel_array; // the smaller pixel array that this thread owns
-  size_t width, height;
+  filter_method apply;
+  // neighborhood radius in pixels: how many rows/columns around a pixel the
+  // filter reads to produce it. 0 for pointwise filters, which may overwrite
+  // their input.
+  size_t radius;
+  // variant that reads og_planes instead of og_image, nullptr if there is none
+  filter_method apply_planar;
+  // the filter applied to one pixel, so that it can be fused with the
+  // pointwise filters next to it in a chain; nullptr if there is none
+  pixel_method apply_pixel;
+} Filter;
+
+// Per-channel byte-to-byte maps: a tone operation, or several composed into
+// one, applied to a pixel with three lookups.
+typedef struct {
+  rgb_value b[UCHAR_MAX + 1];
+  rgb_value g[UCHAR_MAX + 1];
+  rgb_value r[UCHAR_MAX + 1];
+} Lut;
+
+// The tables a histogram filter derives from the image's histogram.
+typedef enum {
+  HISTOGRAM_AUTOLEVELS, // stretch each channel's range, less outliers, to
+                        // 0..255
+  HISTOGRAM_EQUALIZE, // spread each channel's values evenly over 0..255
+} histogram_op;
+
+// Per-channel counts of every value over an image. A whole number of cache
+// lines, so that threads can count into histograms next to each other.
+typedef struct {
+  uint32_t b[UCHAR_MAX + 1];
+  uint32_t g[UCHAR_MAX + 1];
+  uint32_t r[UCHAR_MAX + 1];
+} Histogram;
+
+// One pass over the image of a filter chain: a single filter, or a run of
+// pointwise filters fused into one per-pixel loop.
+typedef struct {
+  Filter filter; // the filter, or the fused kernel
+  pixel_method pixel_ops[FILTER_CHAIN_MAX]; // pointwise filters, in order
+  size_t pixel_op_count;
+  Lut lut; // the tables image_pixel_lut applies, if it is one of pixel_ops
+  const ConvolutionKernel *kernel; // what image_apply_t_convolve applies
+  const CheeseHoles *holes; // what image_apply_t_cheese punches
+  orientation orient; // how image_apply_t_orient moves the pixels
+} ChainPass;
+
+typedef struct {
+  ChainPass passes[FILTER_CHAIN_MAX];
+  size_t pass_count;
+  size_t radius; // sum of the passes' radii: the halo the whole chain needs
+} FilterChain;
+
+// Intermediate images of a chain of passes, kept per pool worker rather than
+// per region: a worker runs one region at a time, so its pair is free for
+// the next one. Each holds a strip of the widest region grown by the chain's
+// halo, so together they scale with the worker count, not the image size.
+typedef struct {
+  PixelBuffer *buffers; // worker w's pair: buffers[2 * w] and [2 * w + 1]
+  size_t workers; // number of pairs
+} ChainScratch;
+
+struct ThreadData {
+  PixelBuffer thread_pixels; // view of the thread's region of the output image
+  size_t width, height; // size of the region
   const Image *og_image;
+  PlanarBuffer *og_planes; // planar copy of og_image (planar layout only)
+  PlanarBuffer thread_planes; // planar scratch output (planar layout only)
+  const IntegralImage *integral; // summed-area table of og_image (box mean)
+  const GaussianImage *gaussian; // Gaussian blur of og_image (Gaussian)
+  const ResizeImage *resize; // og_image resampled horizontally (resize)
+  Region region; // the region, its rows counted from the first filtered row
+  size_t row_start; // the og_image row this thread's first row comes from
+  // where og_image's first pixel lies in the whole image: og_image is a band
+  // when streaming, and a region's scratch image inside a chain
+  size_t origin_row, origin_col;
   size_t start, end;
   // the index of where this threads window onto the og_image starts/ends
   int rShift, gShift, bShift;
-} ThreadData;
+  size_t blur_radius; // box blur radius in pixels
+  filter_method filter_func; // the filter this thread runs
+  int output_fd; // file to write finished rows to, -1 if written in place
+  off_t output_offset; // file offset of the thread's first pixel
+  size_t output_stride; // bytes between rows in the output file
+  // EXIT_SUCCESS once the thread's rows are written; a filter that cannot
+  // filter its region sets EXIT_FAILURE
+  int status;
+  const FilterChain *chain; // the filter chain being run
+  const ChainPass *pass; // the pass being run, read by fused pointwise passes
+  // intermediate results between the passes of a chain, shared by every
+  // region; nullptr for a single pass
+  const ChainScratch *scratch;
+};
 
+/** Returns a pointer to the first pixel of a row of a pixel buffer.
+ *
+ * @param  buffer: the pixel buffer.
+ * @param  row: the row index.
+ */
+static inline Pixel *pixel_buffer_row(const PixelBuffer *buffer, size_t row) {
+  return (Pixel *) ((unsigned char *) buffer->data + row * buffer->stride);
+}
 
-Pixel **create_pixel_array_2d(size_t width, size_t height);
+/** Allocates an uninitialized pixel buffer as a single cache-line-aligned
+ * block whose rows are padded to a multiple of the cache line size.
+ *
+ * @param  buffer: the buffer to initialize.
+ * @param  width: Width of the buffer in pixels.
+ * @param  height: Height of the buffer in pixels.
+ * @param  huge_pages: Align large buffers to huge pages and advise the kernel
+ *         to back them with huge pages where supported.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int pixel_buffer_create(PixelBuffer *buffer, size_t width, size_t height,
+                        bool huge_pages);
 
-void free_pixel_array_2d(Pixel **array, size_t height);
+/** Returns a view onto pixels owned elsewhere.
+ *
+ * @param  data: First pixel of row 0.
+ * @param  stride: Bytes between the starts of consecutive rows.
+ * @param  width: Width of the view in pixels.
+ * @param  height: Height of the view in pixels.
+ */
+PixelBuffer pixel_buffer_view(Pixel *data, size_t stride, size_t width,
+                              size_t height);
 
-/** Creates a new image and returns it.
+/** Frees an owned pixel buffer; views are only cleared.
  *
- * @param  pArr: Pixel array of this image.
+ * @param  buffer: the buffer to free.
+ */
+void pixel_buffer_destroy(PixelBuffer *buffer);
+
+/** Creates a new image and returns it. The image takes ownership of the
+ * pixel buffer (views stay owned by their owner).
+ *
+ * @param  pixels: Pixel buffer of this image.
  * @param  width: Width of this image.
  * @param  height: Height of this image.
  * @return A pointer to a new image.
  */
-Image *image_create(Pixel **pArr, int32_t width, int32_t height);
+Image *image_create(const PixelBuffer *pixels, int32_t width, int32_t height);
 
-/** Destroys an image and deallocates its memory. This includes the pixel array
+/** Destroys an image and deallocates its memory. This includes the pixel
+ * buffer unless it is a view.
  *
  * @param  img: the image to destroy.
  */
 void image_destroy(Image **img);
 
-/** Returns a double pointer to the pixel array.
+/** Returns a pointer to the pixel buffer.
  *
  * @param  img: the image.
  */
-Pixel **image_get_pixels(const Image *img);
+PixelBuffer *image_get_pixels(Image *img);
 
 /** Returns the width of the image.
  *
@@ -80,19 +346,57 @@ void image_apply_cheese(Image *img);
 
 void *image_apply_t_bw(void *data);
 
-void *image_apply_t_cheese(void *data);
-
 void *image_apply_t_boxblur(void *data);
 
 void *image_apply_t_colorshift(void *data);
 
+Pixel image_pixel_bw(Pixel pixel, const ThreadData *data);
+
+Pixel image_pixel_colorshift(Pixel pixel, const ThreadData *data);
+
+extern const Filter FILTER_BW;
+
+extern const Filter FILTER_CHEESE;
+
+extern const Filter FILTER_BOXBLUR;
+
+extern const Filter FILTER_COLORSHIFT;
+
+extern const Filter FILTER_BOXMEAN;
+
+extern const Filter FILTER_LUT;
+
+extern const Filter FILTER_GAUSSIAN;
+
+extern const Filter FILTER_CONVOLVE;
+
+extern const Filter FILTER_RESIZE;
+
+extern const Filter FILTER_MEDIAN;
+
+extern const Filter FILTER_HISTOGRAM;
+
+extern const Filter FILTER_ORIENT;
+
 /**
- * Converts the image to grayscale. If the scaling factor is less than 1 the new
- * image will be smaller, if it is larger than 1, the new image will be larger.
+ * Resizes the image by a factor with a Lanczos filter. If the scaling factor
+ * is less than 1 the new image will be smaller, if it is larger than 1, the
+ * new image will be larger. The image's pixels are replaced by an owned
+ * buffer of the new size; on failure the image is left alone.
  *
  * @param  img: the image.
  * @param  factor: the scaling factor
  */
 void image_apply_resize(Image *img, float factor);
 
+/**
+ * Rotates, flips or transposes the image. The image's pixels are replaced by
+ * an owned buffer, and its width and height swap if the orientation swaps
+ * the axes; on failure the image is left alone.
+ *
+ * @param  img: the image.
+ * @param  orient: how to move the pixels.
+ */
+void image_apply_orient(Image *img, orientation orient);
+
 #endif
@@ -0,0 +1,55 @@
+#ifndef THREADEDIMAGEPROCESSOR_INTEGRAL_H
+#define THREADEDIMAGEPROCESSOR_INTEGRAL_H
+
+#include "Image.h"
+#include "ThreadPool.h"
+
+/** Allocates an unbuilt summed-area table for images of up to width x height
+ * pixels. Entries are 64 bits wide only if the sum of a full-white image
+ * that size does not fit in 32 bits.
+ *
+ * @param  table: the table to initialize.
+ * @param  width: Width of the images in pixels.
+ * @param  height: Largest height of the images in pixels.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int integral_image_create(IntegralImage *table, size_t width, size_t height);
+
+/** Frees a summed-area table. Safe to call on a zeroed table.
+ *
+ * @param  table: the table to free.
+ */
+void integral_image_destroy(IntegralImage *table);
+
+/** Builds the summed-area table of an image on the pool: one pass sums each
+ * row band's rows, a second accumulates each column stripe down the rows.
+ *
+ * @param  pool: the worker thread pool.
+ * @param  image: the image, no larger than the table was created for.
+ * @param  table: the table to build.
+ */
+void integral_image_build(ThreadPool *pool, const Image *image,
+                          IntegralImage *table);
+
+/** Returns the mean of a rectangle of the image in O(1), rounded down per
+ * channel.
+ *
+ * @param  table: the built table.
+ * @param  row: first row of the rectangle.
+ * @param  col: first column of the rectangle.
+ * @param  rows: number of rows, at least 1.
+ * @param  cols: number of columns, at least 1.
+ * @return the mean pixel.
+ */
+Pixel integral_image_mean(const IntegralImage *table, size_t row, size_t col,
+                          size_t rows, size_t cols);
+
+/** Box blur that answers every window from the thread's integral table
+ * instead of scanning the image: the same output as image_apply_t_boxblur,
+ * at any radius, from one table build.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_boxmean(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_INTEGRAL_H
@@ -0,0 +1,68 @@
+#ifndef THREADEDIMAGEPROCESSOR_LUT_H
+#define THREADEDIMAGEPROCESSOR_LUT_H
+
+#include "Image.h"
+
+/** Fills the tables with the identity map.
+ *
+ * @param  lut: the tables.
+ */
+void lut_identity(Lut *lut);
+
+/** Fills the tables with a per-channel color shift, saturating at 0 and 255:
+ * the map image_pixel_colorshift applies.
+ *
+ * @param  lut: the tables.
+ * @param  r_shift: shift of the red channel.
+ * @param  g_shift: shift of the green channel.
+ * @param  b_shift: shift of the blue channel.
+ */
+void lut_colorshift(Lut *lut, int r_shift, int g_shift, int b_shift);
+
+/** Fills the tables with a contrast change: every value moves away from (or,
+ * for a factor below 1, toward) mid-gray 128 by the factor.
+ *
+ * @param  lut: the tables.
+ * @param  factor: the contrast factor, at least 0; 1 leaves values alone.
+ */
+void lut_contrast(Lut *lut, double factor);
+
+/** Fills the tables with a gamma correction: value v maps to
+ * 255 * (v / 255)^(1 / gamma), so a gamma above 1 brightens midtones.
+ *
+ * @param  lut: the tables.
+ * @param  gamma: the gamma, greater than 0.
+ */
+void lut_gamma(Lut *lut, double gamma);
+
+/** Fills the tables with a levels stretch: black maps to 0, white to 255,
+ * values between them linearly in between and values outside them clip.
+ *
+ * @param  lut: the tables.
+ * @param  black: the input value that becomes 0.
+ * @param  white: the input value that becomes 255, greater than black.
+ */
+void lut_levels(Lut *lut, int black, int white);
+
+/** Composes two sets of tables into one that applies lut, then next.
+ *
+ * @param  lut: the tables applied first, replaced by the composition.
+ * @param  next: the tables applied second.
+ */
+void lut_compose(Lut *lut, const Lut *next);
+
+/** Maps each pixel of the thread's region through its pass's tables.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_lut(void *data);
+
+/** Maps one pixel through its pass's tables.
+ *
+ * @param  pixel: the pixel.
+ * @param  data: the ThreadData, whose pass holds the tables.
+ * @return the mapped pixel.
+ */
+Pixel image_pixel_lut(Pixel pixel, const ThreadData *data);
+
+#endif //THREADEDIMAGEPROCESSOR_LUT_H
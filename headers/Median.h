@@ -0,0 +1,22 @@
+#ifndef THREADEDIMAGEPROCESSOR_MEDIAN_H
+#define THREADEDIMAGEPROCESSOR_MEDIAN_H
+
+#include "Image.h"
+
+/** Median filter: sets each channel of each pixel to the median of that
+ * channel over the (2r+1)x(2r+1) window around it, r being the pass's
+ * radius; near the edges only the pixels inside the image count, and of an
+ * even count the lower median is taken.
+ *
+ * The thread keeps a histogram of the window's rows for every column its
+ * windows reach, and slides them down a row at a time; the window's own
+ * histogram slides right by adding one column's histogram and removing
+ * another's. Histograms are split into 16 coarse bins, which are kept up to
+ * date, and 256 fine bins, of which only the coarse bin holding the median
+ * is brought up to date, so a pixel costs the same whatever the radius.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_median(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_MEDIAN_H
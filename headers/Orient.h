@@ -0,0 +1,30 @@
+#ifndef THREADEDIMAGEPROCESSOR_ORIENT_H
+#define THREADEDIMAGEPROCESSOR_ORIENT_H
+
+#include "Image.h"
+
+/** Returns the name of an orientation, as given as a filter on the command
+ * line: rotate=90, rotate=180, rotate=270, flip=h, flip=v or transpose.
+ *
+ * @param  orient: the orientation.
+ */
+const char *orientation_name(orientation orient);
+
+/** Whether an orientation swaps the image's width and height.
+ *
+ * @param  orient: the orientation.
+ */
+bool orientation_swaps_axes(orientation orient);
+
+/** Orientation filter: fills the thread's region of the output image, whose
+ * size is the input's with the axes swapped if the pass's orientation swaps
+ * them, with the input pixels its orientation moves there. Rows that read a
+ * row of the input run straight through it, or mirrored; rows that read a
+ * column of it are done a square tile at a time, so the input lines a tile
+ * reads stay in cache while the tile is written.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_orient(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_ORIENT_H
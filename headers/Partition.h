@@ -0,0 +1,50 @@
+#ifndef THREADEDIMAGEPROCESSOR_PARTITION_H
+#define THREADEDIMAGEPROCESSOR_PARTITION_H
+
+#include <stddef.h>
+
+typedef enum {
+  PARTITION_ROWS, // horizontal bands of whole rows, one per part
+  PARTITION_COLUMNS, // vertical stripes of whole columns, one per part
+  PARTITION_TILES, // a grid of fixed-size tiles, however many parts
+} partition_mode;
+
+typedef struct {
+  partition_mode mode;
+  size_t tile_width; // tile size in pixels, PARTITION_TILES only
+  size_t tile_height;
+} Partition;
+
+typedef struct {
+  size_t row, col; // origin of the region
+  size_t width, height;
+} Region;
+
+/** Splits length items into parts nearly equal runs and returns run index:
+ * the first length % parts runs get one extra item.
+ *
+ * @param  length: number of items to split.
+ * @param  parts: number of runs.
+ * @param  index: the run to return.
+ * @param  first: where to store the first item of the run.
+ * @param  size: where to store the number of items in the run.
+ */
+void partition_split(size_t length, size_t parts, size_t index, size_t *first,
+                     size_t *size);
+
+/** Cuts a width x height area into regions that cover it without
+ * overlapping, ordered row-major.
+ *
+ * @param  partition: how to cut the area.
+ * @param  width: Width of the area in pixels.
+ * @param  height: Height of the area in pixels.
+ * @param  parts: number of bands or stripes to make, capped so that none is
+ *         empty; ignored for tiles.
+ * @param  regions: where to store the allocated array of regions.
+ * @param  count: where to store the number of regions.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int partition_image(const Partition *partition, size_t width, size_t height,
+                    size_t parts, Region **regions, size_t *count);
+
+#endif //THREADEDIMAGEPROCESSOR_PARTITION_H
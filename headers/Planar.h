@@ -0,0 +1,65 @@
+#ifndef THREADEDIMAGEPROCESSOR_PLANAR_H
+#define THREADEDIMAGEPROCESSOR_PLANAR_H
+
+#include "Image.h"
+
+/** Allocates an uninitialized planar buffer. The three planes share one
+ * cache-line-aligned allocation and every plane row starts on a cache line.
+ *
+ * @param  planes: the planar buffer to initialize.
+ * @param  width: Width of the buffer in pixels.
+ * @param  height: Height of the buffer in pixels.
+ * @param  huge_pages: Back a large buffer with huge pages where supported.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int planar_buffer_create(PlanarBuffer *planes, size_t width, size_t height,
+                         bool huge_pages);
+
+/** Frees a planar buffer.
+ *
+ * @param  planes: the planar buffer to free.
+ */
+void planar_buffer_destroy(PlanarBuffer *planes);
+
+/** Splits a run of packed pixels into three channel planes.
+ *
+ * @param  src: the packed pixels.
+ * @param  r: destination red plane run.
+ * @param  g: destination green plane run.
+ * @param  b: destination blue plane run.
+ * @param  count: number of pixels.
+ */
+void deinterleave_row(const Pixel *src, rgb_value *r, rgb_value *g,
+                      rgb_value *b, size_t count);
+
+/** Merges three channel plane runs into packed pixels.
+ *
+ * @param  r: source red plane run.
+ * @param  g: source green plane run.
+ * @param  b: source blue plane run.
+ * @param  dst: the destination packed pixels.
+ * @param  count: number of pixels.
+ */
+void interleave_row(const rgb_value *r, const rgb_value *g, const rgb_value *b,
+                    Pixel *dst, size_t count);
+
+/**
+ * Deinterleaves a run of whole rows of an image into planes, at the same
+ * coordinates.
+ * @param image the packed image
+ * @param planes the destination planes, at least as large as the image
+ * @param first_row the first row to deinterleave
+ * @param rows the number of rows to deinterleave
+ */
+void image_deinterleave_rows(const Image *image, const PlanarBuffer *planes,
+                             size_t first_row, size_t rows);
+
+void *image_apply_t_bw_planar(void *data);
+
+void *image_apply_t_boxblur_planar(void *data);
+
+void *image_apply_t_colorshift_planar(void *data);
+
+void *image_apply_t_lut_planar(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_PLANAR_H
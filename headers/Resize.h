@@ -0,0 +1,54 @@
+#ifndef THREADEDIMAGEPROCESSOR_RESIZE_H
+#define THREADEDIMAGEPROCESSOR_RESIZE_H
+
+#include "Image.h"
+#include "ThreadPool.h"
+
+/** Returns the name of a resize method, as accepted on the command line.
+ *
+ * @param  method: the method.
+ */
+const char *resize_method_name(resize_method method);
+
+/** Allocates an unbuilt resize and computes its weight tables: each output
+ * row's and column's input positions and weights, once for the whole job.
+ * When shrinking, the filter is widened by the scale so every input pixel
+ * contributes.
+ *
+ * @param  resize: the resize to initialize.
+ * @param  in_width: Width of the input image in pixels.
+ * @param  in_height: Height of the input image in pixels.
+ * @param  out_width: Width of the output image in pixels.
+ * @param  out_height: Height of the output image in pixels.
+ * @param  method: the resampling filter.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int resize_image_create(ResizeImage *resize, size_t in_width,
+                        size_t in_height, size_t out_width, size_t out_height,
+                        resize_method method);
+
+/** Frees a resize. Safe to call on a zeroed resize.
+ *
+ * @param  resize: the resize to free.
+ */
+void resize_image_destroy(ResizeImage *resize);
+
+/** Runs the horizontal pass of a resize over an image, a band of rows per
+ * task on the pool.
+ *
+ * @param  pool: the worker thread pool, or nullptr to run on the caller.
+ * @param  image: the input image, of the size the resize was created for.
+ * @param  resize: the resize to build.
+ */
+void resize_image_build(ThreadPool *pool, const Image *image,
+                        ResizeImage *resize);
+
+/** Resize that runs the vertical pass for the thread's region of the output
+ * image, reading the thread's built resize; each output row is a weighted
+ * sum of whole rows of it, taken with the vector kernels.
+ *
+ * @param  data: the ThreadData.
+ */
+void *image_apply_t_resize(void *data);
+
+#endif //THREADEDIMAGEPROCESSOR_RESIZE_H
@@ -0,0 +1,68 @@
+#ifndef THREADEDIMAGEPROCESSOR_SIMD_H
+#define THREADEDIMAGEPROCESSOR_SIMD_H
+
+#include "Image.h"
+
+// fraction bits of the fixed-point weights simd_resample_row takes: weights
+// up to 1.5 times 255 still sum within 32 bits
+#define RESAMPLE_SHIFT 22
+
+typedef enum {
+  SIMD_SCALAR, // plain C
+  SIMD_SSE41, // 128-bit vectors: SSSE3 shuffles and SSE4.1
+  SIMD_AVX2, // 256-bit vectors
+  SIMD_AVX512, // 512-bit vectors: AVX-512F and AVX-512BW
+} simd_level;
+
+/** Picks the widest vector kernels the CPU supports, up to a cap, for every
+ * simd_* row function. Call before any thread runs a kernel; until then the
+ * scalar kernels are used. Every level gives bit-identical results.
+ *
+ * @param  cap: the widest level to use.
+ * @return the level picked.
+ */
+simd_level simd_select(simd_level cap);
+
+/** Returns the name of a level, as accepted on the command line.
+ *
+ * @param  level: the level.
+ */
+const char *simd_level_name(simd_level level);
+
+/** Converts a run of pixels to grayscale with pixel_gray. The source and
+ * destination may be the same run.
+ *
+ * @param  src: the source pixels.
+ * @param  dst: the destination pixels.
+ * @param  count: number of pixels.
+ */
+void simd_bw_row(const Pixel *src, Pixel *dst, size_t count);
+
+/** Adds a shift to each channel of a run of pixels, saturating at 0 and 255.
+ * The source and destination may be the same run.
+ *
+ * @param  src: the source pixels.
+ * @param  dst: the destination pixels.
+ * @param  count: number of pixels.
+ * @param  r_shift: shift of the red channel.
+ * @param  g_shift: shift of the green channel.
+ * @param  b_shift: shift of the blue channel.
+ */
+void simd_colorshift_row(const Pixel *src, Pixel *dst, size_t count,
+                         int r_shift, int g_shift, int b_shift);
+
+/** Resamples a run of bytes down a column of rows: byte i of dst becomes the
+ * weighted sum of byte i of each row, rounded and clamped to 0..255.
+ *
+ * @param  src: the first byte of the run in the first row.
+ * @param  stride: bytes between the starts of consecutive rows.
+ * @param  weights: the weight of each row, with RESAMPLE_SHIFT fraction bits.
+ * @param  taps: number of rows.
+ * @param  dst: the destination bytes.
+ * @param  count: number of bytes.
+ */
+void simd_resample_row(const rgb_value *src, size_t stride,
+                       const int32_t *weights, size_t taps, rgb_value *dst,
+                       size_t count);
+
+#endif //THREADEDIMAGEPROCESSOR_SIMD_H
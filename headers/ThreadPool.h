@@ -0,0 +1,92 @@
+#ifndef THREADEDIMAGEPROCESSOR_THREADPOOL_H
+#define THREADEDIMAGEPROCESSOR_THREADPOOL_H
+
+#include <stddef.h>
+
+/** A task run by the pool: one call per index of a batch.
+ *
+ * @param  context: the batch's shared context.
+ * @param  index: the index of this task in the batch.
+ */
+typedef void (*pool_task)(void *context, size_t index);
+
+typedef struct ThreadPool ThreadPool;
+
+typedef enum {
+  POOL_AFFINITY_NONE, // let the OS scheduler place the workers
+  POOL_AFFINITY_CORES, // pin each worker to a core of its own
+  POOL_AFFINITY_NODES, // pin each worker to the cores of one NUMA node
+} pool_affinity;
+
+typedef struct {
+  size_t batches; // batches run
+  size_t tasks; // tasks run
+  size_t steals; // times a worker took tasks from another worker's deque
+  // worker time spent waiting for the busiest worker, from the measured
+  // task times: wake-up latency is not counted
+  double idle_seconds;
+  // idle time the batches would have had if every worker had run only the
+  // tasks it started with, from the same task times; the difference to
+  // idle_seconds is what stealing recovered
+  double static_idle_seconds;
+} ThreadPoolStats;
+
+/** Returns the number of worker threads to use by default: the number of
+ * online CPUs, capped by the CPU quota of the process's cgroup if it has one.
+ *
+ * @return the default thread count, at least 1.
+ */
+size_t thread_pool_default_size(void);
+
+/** Starts a pool of worker threads that wait for batches of tasks. Pinned
+ * workers are spread over the cores (or nodes) the process may run on in
+ * order, so workers with neighboring indices share a node.
+ *
+ * @param  thread_count: number of worker threads to start.
+ * @param  affinity: where to pin the workers.
+ * @return the pool, or nullptr on failure.
+ */
+ThreadPool *thread_pool_create(size_t thread_count, pool_affinity affinity);
+
+/** Returns the number of worker threads of a pool.
+ *
+ * @param  pool: the pool.
+ */
+size_t thread_pool_size(const ThreadPool *pool);
+
+/** Runs task(context, i) for every i in [0, count) on the pool's workers and
+ * waits for all of them to return. Each worker starts with a deque holding
+ * a contiguous run of the indices and works through it in order; once it is
+ * empty the worker steals the back half of another worker's deque, so a
+ * slow run of tasks does not hold up the batch.
+ *
+ * @param  pool: the pool.
+ * @param  task: the task to run.
+ * @param  context: context passed to every call of the task.
+ * @param  count: number of tasks in the batch.
+ */
+void thread_pool_run(ThreadPool *pool, pool_task task, void *context,
+                     size_t count);
+
+/** Returns the index of the pool worker running the calling task, below the
+ * pool's size, or 0 when not called from a worker. A worker runs one task at
+ * a time, so tasks can keep working memory per worker rather than per task.
+ */
+size_t thread_pool_worker_index(void);
+
+/** Returns the scheduling statistics accumulated over every batch run so
+ * far.
+ *
+ * @param  pool: the pool.
+ * @param  stats: where to store the statistics.
+ */
+void thread_pool_get_stats(const ThreadPool *pool, ThreadPoolStats *stats);
+
+/** Stops and joins the pool's workers and frees the pool. Safe to call on a
+ * nullptr pool.
+ *
+ * @param  pool: pointer to the pool to destroy.
+ */
+void thread_pool_destroy(ThreadPool **pool);
+
+#endif //THREADEDIMAGEPROCESSOR_THREADPOOL_H
@@ -16,7 +16,7 @@
   do {                                        \
     (var) = calloc((size_t)(count), (size_t)(size)); \
     if ((var) == nullptr) {                      \
-      perror(msg);                            \
+      perror("Error allocating memory with calloc.");                            \
       goto label;                             \
     }                                         \
   } while (0)
@@ -26,13 +26,27 @@
   do {                                        \
     void *_tmp = realloc((var), (size_t)(nbytes)); \
     if (_tmp == nullptr) {                       \
-      perror(msg);                            \
+      perror("Error allocating memory with realloc.");                            \
       goto label;                             \
     } else {                                  \
       (var) = _tmp;                           \
     }                                         \
   } while (0)
 
+// Calls posix_memalign, goto label on error
+#define ALIGNED_ALLOC(var, alignment, nbytes, label) \
+  do {                                        \
+    void *_aa_tmp = nullptr;                  \
+    int _aa_err = posix_memalign(&_aa_tmp, (size_t)(alignment), \
+                                 (size_t)(nbytes)); \
+    if (_aa_err != 0) {                       \
+      errno = _aa_err;                        \
+      perror("Error allocating memory with posix_memalign."); \
+      goto label;                             \
+    }                                         \
+    (var) = _aa_tmp;                          \
+  } while (0)
+
 // Safe free: checks for NULL, frees, then sets pointer to NULL.
 // Usage: SAFE_FREE(ptr);  // ptr must be an lvalue pointer expression
 #define FREE(ptr)                 \
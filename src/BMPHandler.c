@@ -1,17 +1,57 @@
+#define _GNU_SOURCE // sync_file_range
 #include "../headers/BMPHandler.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef IOV_MAX
+#define BMP_IOV_BATCH IOV_MAX
+#else
+#define BMP_IOV_BATCH 16 // _XOPEN_IOV_MAX, the POSIX minimum
+#endif
+
+static int write_all(int fd, const void *buf, size_t count);
+
+static int writev_all(int fd, struct iovec *iov, int iovcnt);
+
+static uint8_t *put_u16(uint8_t *dst, uint16_t value);
+
+static uint8_t *put_u32(uint8_t *dst, uint32_t value);
+
+/**
+ * Size in bytes of one row of 24-bit pixels, including the padding that
+ * aligns every row to 4 bytes.
+ *
+ * @param  width: Width of the image in pixels
+ * @return The padded row size in bytes
+ */
+size_t bmpRowStride(size_t width) {
+  // 3 * width bytes of pixels, rounded up to a multiple of 4
+  return sizeof(Pixel) * width + width % 4;
+}
+
 /**
  * Read BMP header of a BMP file.
  *
  * @param  file: A pointer to the file being read
  * @param  header: Pointer to the destination BMP header
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file ends early.
  */
-void readBMPHeader(FILE *file, BMPHeader *header) {
-  fread(&header->signature, sizeof(uint8_t) * 2, 1, file);
-  fread(&header->file_size, sizeof(uint32_t), 1, file);
-  fread(&header->reserved1, sizeof(uint16_t), 1, file);
-  fread(&header->reserved2, sizeof(uint16_t), 1, file);
-  fread(&header->offset_pixel_array, sizeof(uint32_t), 1, file);
+int readBMPHeader(FILE *file, BMPHeader *header) {
+  if (fread(&header->signature, sizeof(uint8_t) * 2, 1, file) != 1 ||
+      fread(&header->file_size, sizeof(uint32_t), 1, file) != 1 ||
+      fread(&header->reserved1, sizeof(uint16_t), 1, file) != 1 ||
+      fread(&header->reserved2, sizeof(uint16_t), 1, file) != 1 ||
+      fread(&header->offset_pixel_array, sizeof(uint32_t), 1, file) != 1) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
 }
 
 /**
@@ -33,19 +73,23 @@ void writeBMPHeader(FILE *file, const BMPHeader *header) {
  *
  * @param  file: A pointer to the file being read
  * @param  header: Pointer to the destination DIB header
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file ends early.
  */
-void readDIBHeader(FILE *file, DIBHeader *header) {
-  fread(&header->dib_header_size, sizeof(uint32_t), 1, file);
-  fread(&header->image_width_w, sizeof(int32_t), 1, file);
-  fread(&header->image_height_h, sizeof(int32_t), 1, file);
-  fread(&header->planes, sizeof(uint16_t), 1, file);
-  fread(&header->bits_per_pixel, sizeof(uint16_t), 1, file);
-  fread(&header->compression, sizeof(int32_t), 1, file);
-  fread(&header->image_size, sizeof(int32_t), 1, file);
-  fread(&header->x_pixels_per_meter, sizeof(int32_t), 1, file);
-  fread(&header->y_pixels_per_meter, sizeof(int32_t), 1, file);
-  fread(&header->color_table_colors, sizeof(uint32_t), 1, file);
-  fread(&header->important_color_count, sizeof(uint32_t), 1, file);
+int readDIBHeader(FILE *file, DIBHeader *header) {
+  if (fread(&header->dib_header_size, sizeof(uint32_t), 1, file) != 1 ||
+      fread(&header->image_width_w, sizeof(int32_t), 1, file) != 1 ||
+      fread(&header->image_height_h, sizeof(int32_t), 1, file) != 1 ||
+      fread(&header->planes, sizeof(uint16_t), 1, file) != 1 ||
+      fread(&header->bits_per_pixel, sizeof(uint16_t), 1, file) != 1 ||
+      fread(&header->compression, sizeof(int32_t), 1, file) != 1 ||
+      fread(&header->image_size, sizeof(int32_t), 1, file) != 1 ||
+      fread(&header->x_pixels_per_meter, sizeof(int32_t), 1, file) != 1 ||
+      fread(&header->y_pixels_per_meter, sizeof(int32_t), 1, file) != 1 ||
+      fread(&header->color_table_colors, sizeof(uint32_t), 1, file) != 1 ||
+      fread(&header->important_color_count, sizeof(uint32_t), 1, file) != 1) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
 }
 
 /**
@@ -68,6 +112,44 @@ void writeDIBHeader(FILE *file, const DIBHeader *header) {
   fwrite(&header->important_color_count, sizeof(uint32_t), 1, file);
 }
 
+/**
+ * Write the BMP and DIB headers to the start of a file with a single write.
+ *
+ * @param  fd: File descriptor of the file being written
+ * @param  bmp: The BMP header to write
+ * @param  dib: The DIB header to write
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int writeHeaders(int fd, const BMPHeader *bmp, const DIBHeader *dib) {
+  uint8_t buffer[BMP_HEADER_SIZE + BMP_DIB_HEADER_SIZE];
+  uint8_t *p = buffer;
+
+  // serialize field by field: the structs are padded, the file format is not
+  *p++ = bmp->signature[0];
+  *p++ = bmp->signature[1];
+  p = put_u32(p, bmp->file_size);
+  p = put_u16(p, bmp->reserved1);
+  p = put_u16(p, bmp->reserved2);
+  p = put_u32(p, bmp->offset_pixel_array);
+
+  p = put_u32(p, dib->dib_header_size);
+  p = put_u32(p, (uint32_t) dib->image_width_w);
+  p = put_u32(p, (uint32_t) dib->image_height_h);
+  p = put_u16(p, dib->planes);
+  p = put_u16(p, dib->bits_per_pixel);
+  p = put_u32(p, (uint32_t) dib->compression);
+  p = put_u32(p, (uint32_t) dib->image_size);
+  p = put_u32(p, (uint32_t) dib->x_pixels_per_meter);
+  p = put_u32(p, (uint32_t) dib->y_pixels_per_meter);
+  p = put_u32(p, dib->color_table_colors);
+  put_u32(p, dib->important_color_count);
+
+  if (lseek(fd, 0, SEEK_SET) < 0) {
+    return EXIT_FAILURE;
+  }
+  return write_all(fd, buffer, sizeof(buffer));
+}
+
 /**
  * Make BMP header based on width and height. Useful for creating a BMP file.
  *
@@ -80,10 +162,9 @@ void makeBMPHeader(BMPHeader *header, uint32_t width, uint32_t height) {
   header->signature[1] = 'M';
   header->reserved1 = 0;
   header->reserved2 = 0;
-  header->offset_pixel_array = 54;
-  uint32_t image_size = width * height;
+  header->offset_pixel_array = BMP_HEADER_SIZE + BMP_DIB_HEADER_SIZE;
+  const uint32_t image_size = (uint32_t) bmpRowStride(width) * height;
   header->file_size = header->offset_pixel_array + image_size;
-  // TODO: add padding to this equation ^^
 }
 
 /**
@@ -94,15 +175,15 @@ void makeBMPHeader(BMPHeader *header, uint32_t width, uint32_t height) {
  * @param  height: Height of the image that this header is for
  */
 void makeDIBHeader(DIBHeader *header, int32_t width, int32_t height) {
-  header->dib_header_size = sizeof(DIBHeader);
+  header->dib_header_size = BMP_DIB_HEADER_SIZE;
   header->image_width_w = width;
   header->image_height_h = height;
   header->planes = 1;
   header->bits_per_pixel = 24;
-  // TODO: calculate compression
-  header->image_size = width * height;
-  header->x_pixels_per_meter = 3780;
+  header->compression = 0; // BI_RGB
+  header->image_size = (int32_t) bmpRowStride((size_t) width) * height;
   header->x_pixels_per_meter = 3780;
+  header->y_pixels_per_meter = 3780;
   header->color_table_colors = 0;
   header->important_color_count = 0;
 }
@@ -111,47 +192,311 @@ void makeDIBHeader(DIBHeader *header, int32_t width, int32_t height) {
  * Read Pixels from BMP file based on width and height.
  *
  * @param  file: A pointer to the file being read
- * @param  pArr: Pixel array to store the pixels being read
+ * @param  pBuf: Pixel buffer to store the pixels being read
  * @param  width: Width of the pixel array of this image
  * @param  height: Height of the pixel array of this image
+ * @param  offset: Offset of the pixel array in the file
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file ends early or
+ *         cannot be read; the rows not read are then cleared to black.
  */
-void readPixels(FILE *file, Pixel **pArr, size_t width, size_t height) {
+int readPixels(FILE *file, const PixelBuffer *pBuf, size_t width, size_t height,
+               uint32_t offset) {
+  size_t i = 0;
+
   // navigate to the start of the pixel array
-  const long PIXELS_START = 54;
-  fseek(file, PIXELS_START, SEEK_SET);
-  const size_t padding = width % 4;
-  for (size_t i = 0; i < height; ++i) {
-    for (size_t j = 0; j < width; ++j) {
-      fread(&pArr[i][j].b, sizeof(rgb_value), 1, file);
-      fread(&pArr[i][j].g, sizeof(rgb_value), 1, file);
-      fread(&pArr[i][j].r, sizeof(rgb_value), 1, file);
+  if (fseek(file, (long) offset, SEEK_SET) != 0) goto fail;
+  const size_t padding = bmpRowStride(width) - sizeof(Pixel) * width;
+  for (; i < height; ++i) {
+    // pixels are stored in on-disk (BGR) order, so a row is read in one go
+    if (fread(pixel_buffer_row(pBuf, i), sizeof(Pixel), width, file) != width) {
+      goto fail;
+    }
+    // skip the padding
+    if (fseek(file, (long) padding, SEEK_CUR) != 0) {
+      ++i;
+      goto fail;
     }
-    // skip the padding goes here
-    fseek(file, (long) (sizeof(rgb_value) * padding), SEEK_CUR);
   }
+  return EXIT_SUCCESS;
+
+fail:
+  // buffers are not zero-filled, so never leave heap contents in them
+  for (; i < height; ++i) {
+    memset(pixel_buffer_row(pBuf, i), 0, sizeof(Pixel) * width);
+  }
+  return EXIT_FAILURE;
+}
+
+/**
+ * Map a BMP file into memory (private, copy-on-write) so that its pixel array
+ * can be used in place.
+ *
+ * @param  file: A pointer to the file to map
+ * @param  mapping: Pointer to the destination mapping
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int mapBMPFile(FILE *file, BMPMapping *mapping) {
+  struct stat st;
+  const int fd = fileno(file);
+
+  mapping->base = nullptr;
+  mapping->length = 0;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+    return EXIT_FAILURE;
+  }
+
+  // writable private mapping: filters may write into it without touching disk
+  void *base = mmap(nullptr, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    return EXIT_FAILURE;
+  }
+  // the whole pixel array is read front to back
+  madvise(base, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+  mapping->base = base;
+  mapping->length = (size_t) st.st_size;
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Map a pre-sized output file into memory (shared) so that its pixel array
+ * can be written in place. The file's blocks are reserved first, so running
+ * out of space fails here instead of faulting while pixels are stored.
+ *
+ * @param  fd: File descriptor of the output file, opened for reading and
+ *         writing
+ * @param  mapping: Pointer to the destination mapping
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int mapOutputBMPFile(int fd, BMPMapping *mapping) {
+  struct stat st;
+
+  mapping->base = nullptr;
+  mapping->length = 0;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+      posix_fallocate(fd, 0, st.st_size) != 0) {
+    return EXIT_FAILURE;
+  }
+
+  void *base = mmap(nullptr, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    return EXIT_FAILURE;
+  }
+
+  mapping->base = base;
+  mapping->length = (size_t) st.st_size;
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Start writing back a block of a file written through a shared mapping,
+ * without waiting for it, so that the page cache does not pile up dirty
+ * pages until the file is closed. Where the system cannot do this the pages
+ * are written back later as usual.
+ *
+ * @param  fd: File descriptor of the mapped file
+ * @param  offset: File offset of the block
+ * @param  length: Length of the block in bytes
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int flushPixels(int fd, off_t offset, size_t length) {
+#ifdef SYNC_FILE_RANGE_WRITE
+  if (sync_file_range(fd, offset, (off_t) length, SYNC_FILE_RANGE_WRITE) != 0) {
+    return EXIT_FAILURE;
+  }
+#else
+  (void) fd;
+  (void) offset;
+  (void) length;
+#endif
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Make a pixel buffer view straight onto the pixel array of a mapped BMP file.
+ * No pixel data is copied; the view's stride is the padded BMP row size.
+ *
+ * @param  mapping: The mapped BMP file
+ * @param  offset: Offset of the pixel array in the file
+ * @param  width: Width of the pixel array of this image
+ * @param  height: Height of the pixel array of this image
+ * @param  pBuf: Pointer to the destination pixel buffer view
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file is too short.
+ */
+int mapPixels(const BMPMapping *mapping, uint32_t offset, size_t width,
+              size_t height, PixelBuffer *pBuf) {
+  const size_t stride = bmpRowStride(width);
+
+  if (height == 0 || offset > mapping->length ||
+      (mapping->length - offset) / stride < height) {
+    fprintf(stderr, "Pixel array does not fit in the mapped file.\n");
+    return EXIT_FAILURE;
+  }
+
+  *pBuf = pixel_buffer_view((Pixel *) (mapping->base + offset),
+                            stride,
+                            width,
+                            height);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Unmap a BMP file mapped by mapBMPFile or mapOutputBMPFile. Safe to call on
+ * an unused mapping.
+ *
+ * @param  mapping: The mapping to release
+ */
+void unmapBMPFile(BMPMapping *mapping) {
+  if (mapping->base) {
+    munmap(mapping->base, mapping->length);
+  }
+  mapping->base = nullptr;
+  mapping->length = 0;
 }
 
 /**
- * Write Pixels from BMP file based on width and height.
+ * Write Pixels to a BMP file based on width and height. Whole padded rows are
+ * gathered straight from the pixel array and written with a few large
+ * vectored writes.
  *
- * @param  file: A pointer to the file being read or written
- * @param  pArr: Pixel array of the image to write to the file
+ * @param  fd: File descriptor of the file being written
+ * @param  pBuf: Pixel buffer of the image to write to the file
  * @param  width: Width of the pixel array of this image
  * @param  height: Height of the pixel array of this image
+ * @param  offset: Offset of the pixel array in the file
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
  */
-void writePixels(FILE *file, const Pixel * const *pArr, size_t width, size_t height) {
-  const long PIXELS_START = 54;
+int writePixels(int fd, const PixelBuffer *pBuf, size_t width, size_t height,
+                off_t offset) {
+  static const uint8_t PADDING[3] = {0};
+  const size_t padding = bmpRowStride(width) - sizeof(Pixel) * width;
+  struct iovec iov[BMP_IOV_BATCH];
+  int iovcnt = 0;
+
   // navigate to the start of the pixel array
-  fseek(file, PIXELS_START, SEEK_SET);
+  if (lseek(fd, offset, SEEK_SET) < 0) {
+    return EXIT_FAILURE;
+  }
 
-  const size_t padding = width % 4;
+  // rows are already in on-disk (BGR) order: gather them, don't copy them
   for (size_t i = 0; i < height; ++i) {
-    for (size_t j = 0; j < width; ++j) {
-      fwrite(&pArr[i][j].b, sizeof(rgb_value), 1, file);
-      fwrite(&pArr[i][j].g, sizeof(rgb_value), 1, file);
-      fwrite(&pArr[i][j].r, sizeof(rgb_value), 1, file);
+    iov[iovcnt].iov_base = pixel_buffer_row(pBuf, i);
+    iov[iovcnt].iov_len = sizeof(Pixel) * width;
+    ++iovcnt;
+    if (padding) {
+      iov[iovcnt].iov_base = (void *) PADDING;
+      iov[iovcnt].iov_len = padding;
+      ++iovcnt;
+    }
+    // flush when the batch cannot take another padded row
+    if (iovcnt > BMP_IOV_BATCH - 2 || i == height - 1) {
+      if (writev_all(fd, iov, iovcnt) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+      }
+      iovcnt = 0;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Write a block of pixel rows at its final position in a BMP file with
+ * positional writes. The file position is not used, so several threads may
+ * write disjoint blocks of the same file concurrently.
+ *
+ * @param  fd: File descriptor of the file being written
+ * @param  pBuf: Pixel buffer holding the block to write
+ * @param  width: Width of the block in pixels
+ * @param  height: Height of the block in pixels
+ * @param  offset: File offset of the block's first pixel
+ * @param  stride: Bytes between consecutive rows in the file
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int pwritePixels(int fd, const PixelBuffer *pBuf, size_t width, size_t height,
+                 off_t offset, size_t stride) {
+  for (size_t i = 0; i < height; ++i) {
+    const uint8_t *row = (const uint8_t *) pixel_buffer_row(pBuf, i);
+    size_t remaining = sizeof(Pixel) * width;
+    off_t position = offset + (off_t) (i * stride);
+
+    while (remaining > 0) {
+      ssize_t written = pwrite(fd, row, remaining, position);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        perror("Error writing pixels.");
+        return EXIT_FAILURE;
+      }
+      row += written;
+      remaining -= (size_t) written;
+      position += written;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Write the whole buffer, retrying on short writes and interrupts.
+ * @param fd the file descriptor to write to
+ * @param buf the bytes to write
+ * @param count the number of bytes to write
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure
+ */
+static int write_all(int fd, const void *buf, size_t count) {
+  struct iovec iov = {.iov_base = (void *) buf, .iov_len = count};
+  return writev_all(fd, &iov, 1);
+}
+
+/**
+ * Write every iovec, retrying on short writes and interrupts. The iovecs are
+ * advanced in place as data is written.
+ * @param fd the file descriptor to write to
+ * @param iov the buffers to write
+ * @param iovcnt the number of buffers
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure
+ */
+static int writev_all(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t written = writev(fd, iov, iovcnt);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      perror("Error writing pixels.");
+      return EXIT_FAILURE;
+    }
+    // skip the buffers that were fully written, trim the partial one
+    size_t remaining = (size_t) written;
+    while (iovcnt > 0 && remaining >= iov->iov_len) {
+      remaining -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (uint8_t *) iov->iov_base + remaining;
+      iov->iov_len -= remaining;
     }
-    // skip the padding
-    fseek(file, (long) (sizeof(rgb_value) * padding), SEEK_CUR);
   }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Store a 16-bit value in little-endian order.
+ * @return a pointer just past the stored value
+ */
+static uint8_t *put_u16(uint8_t *dst, uint16_t value) {
+  dst[0] = (uint8_t) value;
+  dst[1] = (uint8_t) (value >> 8);
+  return dst + 2;
+}
+
+/**
+ * Store a 32-bit value in little-endian order.
+ * @return a pointer just past the stored value
+ */
+static uint8_t *put_u32(uint8_t *dst, uint32_t value) {
+  dst[0] = (uint8_t) value;
+  dst[1] = (uint8_t) (value >> 8);
+  dst[2] = (uint8_t) (value >> 16);
+  dst[3] = (uint8_t) (value >> 24);
+  return dst + 4;
 }
@@ -0,0 +1,92 @@
+#include "../headers/BoundedQueue.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../headers/macros.h"
+
+struct BoundedQueue {
+  pthread_mutex_t lock;
+  pthread_cond_t not_full;
+  pthread_cond_t not_empty;
+  void **items; // ring buffer of capacity items
+  size_t capacity;
+  size_t head; // index of the oldest item
+  size_t count;
+  bool closed;
+};
+
+BoundedQueue *bounded_queue_create(size_t capacity) {
+  BoundedQueue *queue = nullptr;
+
+  CALLOC(queue, 1, sizeof(BoundedQueue), fail);
+  CALLOC(queue->items, capacity, sizeof(void *), fail_items);
+  if (pthread_mutex_init(&queue->lock, nullptr) != 0) goto fail_lock;
+  if (pthread_cond_init(&queue->not_full, nullptr) != 0) goto fail_full;
+  if (pthread_cond_init(&queue->not_empty, nullptr) != 0) goto fail_empty;
+  queue->capacity = capacity;
+  return queue;
+
+fail_empty:
+  pthread_cond_destroy(&queue->not_full);
+fail_full:
+  pthread_mutex_destroy(&queue->lock);
+fail_lock:
+  FREE(queue->items);
+fail_items:
+  FREE(queue);
+fail:
+  perror("Error creating queue.");
+  return nullptr;
+}
+
+bool bounded_queue_push(BoundedQueue *queue, void *item) {
+  pthread_mutex_lock(&queue->lock);
+  while (!queue->closed && queue->count == queue->capacity) {
+    pthread_cond_wait(&queue->not_full, &queue->lock);
+  }
+  const bool pushed = !queue->closed;
+  if (pushed) {
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    ++queue->count;
+    pthread_cond_signal(&queue->not_empty);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return pushed;
+}
+
+void *bounded_queue_pop(BoundedQueue *queue) {
+  void *item = nullptr;
+
+  pthread_mutex_lock(&queue->lock);
+  while (!queue->closed && queue->count == 0) {
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  }
+  if (queue->count > 0) {
+    item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    --queue->count;
+    pthread_cond_signal(&queue->not_full);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return item;
+}
+
+void bounded_queue_close(BoundedQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = true;
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+void bounded_queue_destroy(BoundedQueue **queue) {
+  if (!*queue) return;
+
+  pthread_cond_destroy(&(*queue)->not_empty);
+  pthread_cond_destroy(&(*queue)->not_full);
+  pthread_mutex_destroy(&(*queue)->lock);
+  FREE((*queue)->items);
+  FREE(*queue);
+}
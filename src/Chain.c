@@ -0,0 +1,264 @@
+#include "../headers/Chain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../headers/Lut.h"
+#include "../headers/macros.h"
+#include "../headers/ThreadPool.h"
+
+static const Filter FILTER_FUSED = {
+  .apply = image_apply_t_pointwise,
+  .radius = 0,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+/**
+ * Grows the thread's region, in og_image coordinates, by a halo on every
+ * side and clips it to the image.
+ * @param thread_data the thread
+ * @param halo the rows and columns to add on every side
+ * @return the grown region
+ */
+static Region grow_region(const ThreadData *thread_data, size_t halo) {
+  const size_t width = (size_t) thread_data->og_image->width;
+  const size_t height = (size_t) thread_data->og_image->height;
+  const size_t row = thread_data->row_start;
+  const size_t col = thread_data->start;
+  const size_t top = row < halo ? 0 : row - halo;
+  const size_t left = col < halo ? 0 : col - halo;
+  const size_t bottom = row + thread_data->height + halo < height
+                          ? row + thread_data->height + halo
+                          : height;
+  const size_t right = col + thread_data->width + halo < width
+                         ? col + thread_data->width + halo
+                         : width;
+
+  return (Region) {
+    .row = top,
+    .col = left,
+    .width = right - left,
+    .height = bottom - top,
+  };
+}
+
+/**
+ * Reports that a chain has no room for another filter.
+ * @return EXIT_FAILURE
+ */
+static int chain_full(void) {
+  fprintf(stderr, "A filter chain holds at most %d filters.\n",
+          FILTER_CHAIN_MAX);
+  return EXIT_FAILURE;
+}
+
+/**
+ * Starts a pass of its own for a filter.
+ * @param chain the chain
+ * @param filter the filter
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the chain is full
+ */
+static int append_pass(FilterChain *chain, const Filter *filter) {
+  if (chain->pass_count == FILTER_CHAIN_MAX) return chain_full();
+  ChainPass *pass = &chain->passes[chain->pass_count++];
+  pass->filter = *filter;
+  pass->pixel_op_count = 0;
+  if (filter->apply_pixel) {
+    pass->pixel_ops[pass->pixel_op_count++] = filter->apply_pixel;
+  }
+  chain->radius += filter->radius;
+  return EXIT_SUCCESS;
+}
+
+int filter_chain_append(FilterChain *chain, const Filter *filter) {
+  ChainPass *last = chain->pass_count > 0
+                      ? &chain->passes[chain->pass_count - 1]
+                      : nullptr;
+
+  // fuse with the pointwise run before it
+  if (filter->apply_pixel && last && last->pixel_op_count > 0) {
+    if (last->pixel_op_count == FILTER_CHAIN_MAX) return chain_full();
+    last->pixel_ops[last->pixel_op_count++] = filter->apply_pixel;
+    last->filter = FILTER_FUSED;
+    return EXIT_SUCCESS;
+  }
+  return append_pass(chain, filter);
+}
+
+int filter_chain_append_lut(FilterChain *chain, const Lut *lut) {
+  ChainPass *last = chain->pass_count > 0
+                      ? &chain->passes[chain->pass_count - 1]
+                      : nullptr;
+  bool has_lut = false;
+
+  if (last && last->pixel_op_count > 0) {
+    // fold into tables the run already ends with
+    if (last->pixel_ops[last->pixel_op_count - 1] == image_pixel_lut) {
+      lut_compose(&last->lut, lut);
+      return EXIT_SUCCESS;
+    }
+    for (size_t k = 0; k < last->pixel_op_count; ++k) {
+      has_lut |= last->pixel_ops[k] == image_pixel_lut;
+    }
+  }
+
+  // a pass holds one set of tables: join the run unless it has some already
+  if (last && last->pixel_op_count > 0 && !has_lut) {
+    if (filter_chain_append(chain, &FILTER_LUT) != EXIT_SUCCESS) {
+      return EXIT_FAILURE;
+    }
+  } else if (append_pass(chain, &FILTER_LUT) != EXIT_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+  chain->passes[chain->pass_count - 1].lut = *lut;
+  return EXIT_SUCCESS;
+}
+
+filter_method filter_chain_method(const FilterChain *chain) {
+  return chain->pass_count == 1 ? chain->passes[0].filter.apply
+                                : image_apply_t_chain;
+}
+
+int chain_scratch_create(ChainScratch *scratch, const FilterChain *chain,
+                         size_t workers, size_t width, size_t height) {
+  // a pass writes one buffer while the next reads the other
+  const size_t per_worker = chain->pass_count - 1 < 2
+                              ? chain->pass_count - 1
+                              : 2;
+
+  *scratch = (ChainScratch) {0};
+  CALLOC(scratch->buffers, 2 * workers, sizeof(PixelBuffer), fail);
+  scratch->workers = workers;
+  for (size_t w = 0; w < workers; ++w) {
+    for (size_t j = 0; j < per_worker; ++j) {
+      if (pixel_buffer_create(&scratch->buffers[2 * w + j], width, height,
+                              false) != EXIT_SUCCESS) {
+        chain_scratch_destroy(scratch);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+
+fail:
+  return EXIT_FAILURE;
+}
+
+void chain_scratch_destroy(ChainScratch *scratch) {
+  for (size_t i = 0; scratch->buffers && i < 2 * scratch->workers; ++i) {
+    pixel_buffer_destroy(&scratch->buffers[i]);
+  }
+  FREE(scratch->buffers);
+  *scratch = (ChainScratch) {0};
+}
+
+/**
+ * Runs every pass of the chain over a strip of a region: each pass but the
+ * last writes to the scratch pair, covering the strip grown by the halo the
+ * passes after it still need.
+ * @param strip the thread, its rows cut down to the strip
+ * @param scratch_pair the running worker's scratch buffers
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if a pass failed
+ */
+static int run_strip(const ThreadData *strip,
+                     const PixelBuffer *scratch_pair) {
+  const FilterChain *chain = strip->chain;
+  Image scratch_images[2];
+  const Image *input_image = strip->og_image;
+  // where the input of the current pass lies in og_image
+  Region input = {
+    .width = (size_t) strip->og_image->width,
+    .height = (size_t) strip->og_image->height,
+  };
+  size_t halo = chain->radius;
+
+  for (size_t i = 0; i < chain->pass_count; ++i) {
+    const ChainPass *pass = &chain->passes[i];
+    ThreadData stage = *strip;
+
+    // A pass produces the strip grown by the halo the passes after it
+    // read. Its input covers that grown by its own radius, clipped to the
+    // image, so a scratch image has edges exactly where og_image has them.
+    halo -= pass->filter.radius;
+    const Region output = grow_region(strip, halo);
+    stage.og_image = input_image;
+    stage.origin_row = strip->origin_row + input.row;
+    stage.origin_col = strip->origin_col + input.col;
+    stage.pass = pass;
+    stage.row_start = output.row - input.row;
+    stage.start = output.col - input.col;
+    stage.end = stage.start + output.width - 1;
+    stage.width = output.width;
+    stage.height = output.height;
+
+    if (i + 1 < chain->pass_count) {
+      const PixelBuffer *scratch = &scratch_pair[i % 2];
+      stage.thread_pixels = pixel_buffer_view(scratch->data,
+                                              scratch->stride,
+                                              output.width,
+                                              output.height);
+      scratch_images[i % 2] = (Image) {
+        .pixels = stage.thread_pixels,
+        .width = (int32_t) output.width,
+        .height = (int32_t) output.height,
+      };
+    }
+    pass->filter.apply(&stage);
+    // a failed pass leaves its output unwritten, so later passes must not run
+    if (stage.status != EXIT_SUCCESS) return stage.status;
+
+    input_image = &scratch_images[i % 2];
+    input = output;
+  }
+  return EXIT_SUCCESS;
+}
+
+void *image_apply_t_chain(void *data) {
+  ThreadData *thread_data = (ThreadData *) data;
+  // the running worker's pair, free until this region is done
+  const PixelBuffer *scratch_pair =
+      &thread_data->scratch->buffers[2 * thread_pool_worker_index()];
+
+  // a strip at a time, so the scratch images hold a strip and its halo
+  // however tall the region is
+  for (size_t row = 0; row < thread_data->height; row += CHAIN_STRIP_ROWS) {
+    ThreadData strip = *thread_data;
+    strip.row_start = thread_data->row_start + row;
+    strip.height = thread_data->height - row < CHAIN_STRIP_ROWS
+                     ? thread_data->height - row
+                     : CHAIN_STRIP_ROWS;
+    strip.thread_pixels = pixel_buffer_view(
+        pixel_buffer_row(&thread_data->thread_pixels, row),
+        thread_data->thread_pixels.stride,
+        thread_data->width,
+        strip.height);
+    if (run_strip(&strip, scratch_pair) != EXIT_SUCCESS) {
+      thread_data->status = EXIT_FAILURE;
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+void *image_apply_t_pointwise(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const ChainPass *pass = thread_data->pass;
+
+  const PixelBuffer *read_pixels = &thread_data->og_image->pixels;
+  const PixelBuffer *write_pixels = &thread_data->thread_pixels;
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const Pixel *src = pixel_buffer_row(read_pixels, thread_data->row_start + i)
+                       + thread_data->start;
+    Pixel *dst = pixel_buffer_row(write_pixels, i);
+    for (size_t j = 0; j < thread_data->width; ++j) {
+      Pixel pixel = src[j];
+      for (size_t k = 0; k < pass->pixel_op_count; ++k) {
+        pixel = pass->pixel_ops[k](pixel, thread_data);
+      }
+      dst[j] = pixel;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,158 @@
+#include "../headers/Cheese.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "../headers/macros.h"
+
+// smallest hole radius in pixels
+#define HOLE_MIN_RADIUS 5
+
+// helper functions
+static uint64_t next_random(uint64_t *state);
+
+static size_t hole_top(const CheeseHole *hole);
+
+static int compare_holes(const void *a, const void *b);
+
+static size_t isqrt(size_t value);
+
+int cheese_holes_create(CheeseHoles *holes, size_t width, size_t height,
+                        uint64_t seed) {
+  const size_t min_dimension = width < height ? width : height;
+  const size_t radius_range = min_dimension / 6;
+  uint64_t state = seed;
+
+  *holes = (CheeseHoles) {0};
+  holes->count = min_dimension * 8 / 100;
+  if (holes->count == 0) return EXIT_SUCCESS;
+  MALLOC(holes->holes, sizeof(CheeseHole) * holes->count, fail);
+  for (size_t i = 0; i < holes->count; ++i) {
+    holes->holes[i] = (CheeseHole) {
+      .row = (size_t) (next_random(&state) % height),
+      .col = (size_t) (next_random(&state) % width),
+      .radius = HOLE_MIN_RADIUS +
+                (radius_range > 0
+                   ? (size_t) (next_random(&state) % radius_range)
+                   : 0),
+    };
+  }
+  qsort(holes->holes, holes->count, sizeof(CheeseHole), compare_holes);
+  return EXIT_SUCCESS;
+
+fail:
+  cheese_holes_destroy(holes);
+  return EXIT_FAILURE;
+}
+
+void cheese_holes_destroy(CheeseHoles *holes) {
+  FREE(holes->holes);
+  *holes = (CheeseHoles) {0};
+}
+
+void cheese_holes_paint(const CheeseHoles *holes, const PixelBuffer *pixels,
+                        size_t row, size_t col) {
+  const size_t row_end = row + pixels->height;
+  const size_t col_end = col + pixels->width;
+
+  for (size_t k = 0; k < holes->count; ++k) {
+    const CheeseHole *hole = &holes->holes[k];
+    const size_t top = hole_top(hole);
+    // the holes are sorted by their top row: the rest start below the block
+    if (top >= row_end) break;
+    if (hole->row + hole->radius < row ||
+        hole->col + hole->radius < col ||
+        (hole->col > hole->radius ? hole->col - hole->radius : 0) >= col_end) {
+      continue;
+    }
+
+    const size_t y_end = hole->row + hole->radius + 1 < row_end
+                           ? hole->row + hole->radius + 1
+                           : row_end;
+    for (size_t y = top > row ? top : row; y < y_end; ++y) {
+      const size_t dy = y > hole->row ? y - hole->row : hole->row - y;
+      // the pixels of the row within radius of the center: dx^2 + dy^2 <=
+      // radius^2
+      const size_t half = isqrt(hole->radius * hole->radius - dy * dy);
+      const size_t left = hole->col > half ? hole->col - half : 0;
+      const size_t right = hole->col + half + 1;
+      const size_t from = left > col ? left : col;
+      const size_t to = right < col_end ? right : col_end;
+      if (from < to) {
+        memset(pixel_buffer_row(pixels, y - row) + (from - col), 0,
+               sizeof(Pixel) * (to - from));
+      }
+    }
+  }
+}
+
+void *image_apply_t_cheese(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const PixelBuffer *read_pixels = &thread_data->og_image->pixels;
+  // a streamed band's last regions may be short
+  const PixelBuffer region = pixel_buffer_view(thread_data->thread_pixels.data,
+                                               thread_data->thread_pixels.stride,
+                                               thread_data->width,
+                                               thread_data->height);
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const Pixel *src = pixel_buffer_row(read_pixels, thread_data->row_start + i)
+                       + thread_data->start;
+    Pixel *dst = pixel_buffer_row(&region, i);
+    // in place, the region already holds its pixels
+    if (src != dst) memcpy(dst, src, sizeof(Pixel) * thread_data->width);
+  }
+  cheese_holes_paint(thread_data->pass->holes,
+                     &region,
+                     thread_data->origin_row + thread_data->row_start,
+                     thread_data->origin_col + thread_data->start);
+  return nullptr;
+}
+
+/**
+ * Steps a splitmix64 generator: small, fast, and good enough to place holes.
+ * @param state the generator's state
+ * @return the next random number
+ */
+static uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15u);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+  return z ^ (z >> 31);
+}
+
+/**
+ * Returns the first image row a hole covers.
+ * @param hole the hole
+ * @return the row
+ */
+static size_t hole_top(const CheeseHole *hole) {
+  return hole->row > hole->radius ? hole->row - hole->radius : 0;
+}
+
+/**
+ * Orders holes by their top row, for qsort.
+ * @param a the first hole
+ * @param b the second hole
+ * @return negative, zero or positive as a starts above, level with or below b
+ */
+static int compare_holes(const void *a, const void *b) {
+  const size_t top_a = hole_top(a);
+  const size_t top_b = hole_top(b);
+
+  return (top_a > top_b) - (top_a < top_b);
+}
+
+/**
+ * Rounds the square root of a value down.
+ * @param value the value
+ * @return the largest root whose square is at most value
+ */
+static size_t isqrt(size_t value) {
+  size_t root = (size_t) sqrt((double) value);
+
+  // the double root may be off by one either way
+  while (root > 0 && root * root > value) --root;
+  while ((root + 1) * (root + 1) <= value) ++root;
+  return root;
+}
@@ -0,0 +1,390 @@
+#include "../headers/Convolve.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "../headers/macros.h"
+
+// largest kernel file read, far more than CONVOLUTION_MAX_SIZE^2 weights need
+#define KERNEL_FILE_MAX (64 * 1024)
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+// convolves the pixels [from, to) of a row whose windows lie inside the image
+typedef void (*interior_method)(const Pixel *const *rows,
+                                const float *weights,
+                                size_t size,
+                                size_t from,
+                                size_t to,
+                                Pixel *dst);
+
+// helper functions
+static int parse_weights(const char *text, ConvolutionKernel *kernel);
+
+static char *read_kernel_file(const char *path);
+
+static rgb_value saturate(float value);
+
+static size_t clamp_size(size_t value, size_t low, size_t high);
+
+static bool border_index(ptrdiff_t index, size_t length, border_mode border,
+                         size_t *mapped);
+
+static Pixel convolve_border(const Image *image,
+                             const ConvolutionKernel *kernel,
+                             size_t row,
+                             size_t col);
+
+static interior_method interior_for(size_t size);
+
+static const char *const BORDER_NAMES[] = {
+  [BORDER_CLAMP] = "clamp",
+  [BORDER_MIRROR] = "mirror",
+  [BORDER_ZERO] = "zero",
+  [BORDER_RENORMALIZE] = "renormalize",
+};
+
+int convolution_kernel_parse(const char *spec, ConvolutionKernel *kernel) {
+  char *text;
+  int status;
+
+  if (spec[0] != '@') return parse_weights(spec, kernel);
+  if ((text = read_kernel_file(spec + 1)) == nullptr) return EXIT_FAILURE;
+  status = parse_weights(text, kernel);
+  FREE(text);
+  return status;
+}
+
+const char *border_mode_name(border_mode border) {
+  return BORDER_NAMES[border];
+}
+
+void *image_apply_t_convolve(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const ConvolutionKernel *kernel = thread_data->pass->kernel;
+  const Image *image = thread_data->og_image;
+  const size_t width = (size_t) image->width;
+  const size_t height = (size_t) image->height;
+  const size_t radius = kernel->size / 2;
+  const size_t start = thread_data->start;
+  const size_t end = start + thread_data->width;
+  // the region's columns whose windows lie inside the image
+  const size_t inner_start = clamp_size(radius, start, end);
+  const size_t inner_end = width > 2 * radius
+                             ? clamp_size(width - radius, inner_start, end)
+                             : inner_start;
+  const interior_method interior = interior_for(kernel->size);
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const size_t row = thread_data->row_start + i;
+    Pixel *dst = pixel_buffer_row(&thread_data->thread_pixels, i);
+    const Pixel *rows[CONVOLUTION_MAX_SIZE];
+
+    if (row < radius || row + radius >= height) {
+      for (size_t x = start; x < end; ++x) {
+        dst[x - start] = convolve_border(image, kernel, row, x);
+      }
+      continue;
+    }
+    for (size_t ky = 0; ky < kernel->size; ++ky) {
+      rows[ky] = pixel_buffer_row(&image->pixels, row - radius + ky);
+    }
+    for (size_t x = start; x < inner_start; ++x) {
+      dst[x - start] = convolve_border(image, kernel, row, x);
+    }
+    interior(rows, kernel->weights, kernel->size, inner_start, inner_end,
+             dst + (inner_start - start));
+    for (size_t x = inner_end; x < end; ++x) {
+      dst[x - start] = convolve_border(image, kernel, row, x);
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Parses the weights of a kernel and applies its divisor.
+ * @param text the weights, optionally followed by /<divisor>
+ * @param kernel the kernel to fill in
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if text is not a kernel
+ */
+static int parse_weights(const char *text, ConvolutionKernel *kernel) {
+  double weights[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  double divisor = 1;
+  size_t count = 0;
+  size_t size = 0;
+  char *end;
+
+  for (;;) {
+    text += strspn(text, ", \t\r\n");
+    if (*text == '\0' || *text == '/') break;
+    if (count == CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE) {
+      return EXIT_FAILURE;
+    }
+    weights[count] = strtod(text, &end);
+    if (end == text || !isfinite(weights[count])) return EXIT_FAILURE;
+    ++count;
+    text = end;
+  }
+  if (*text == '/') {
+    divisor = strtod(++text, &end);
+    if (end == text || !isfinite(divisor) || divisor == 0) {
+      return EXIT_FAILURE;
+    }
+    text = end + strspn(end, " \t\r\n");
+    if (*text != '\0') return EXIT_FAILURE;
+  }
+
+  while (size * size < count) ++size;
+  if (size * size != count || size % 2 == 0) return EXIT_FAILURE;
+  kernel->size = size;
+  kernel->total = 0;
+  for (size_t k = 0; k < count; ++k) {
+    kernel->weights[k] = (float) (weights[k] / divisor);
+    kernel->total += kernel->weights[k];
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Reads a kernel file into a string.
+ * @param path the file
+ * @return the contents, to be freed by the caller, or nullptr on failure
+ */
+static char *read_kernel_file(const char *path) {
+  FILE *file;
+  char *text = nullptr;
+  size_t length;
+
+  if ((file = fopen(path, "r")) == nullptr) {
+    perror("Kernel file could not be opened.");
+    return nullptr;
+  }
+  MALLOC(text, KERNEL_FILE_MAX + 1, cleanup);
+  length = fread(text, 1, KERNEL_FILE_MAX + 1, file);
+  if (ferror(file) || length > KERNEL_FILE_MAX) {
+    fprintf(stderr, "Kernel file could not be read: %s\n", path);
+    FREE(text);
+    goto cleanup;
+  }
+  text[length] = '\0';
+
+cleanup:
+  fclose(file);
+  return text;
+}
+
+/**
+ * Rounds a channel value and clamps it to an RGB value.
+ * @param value the value
+ * @return the rounded, clamped value
+ */
+static rgb_value saturate(float value) {
+  return value <= 0 ? 0
+                    : value >= UCHAR_MAX ? UCHAR_MAX
+                                         : (rgb_value) (value + 0.5f);
+}
+
+/**
+ * Clamps a value to a range.
+ * @param value the value
+ * @param low the lower bound
+ * @param high the upper bound, at least low
+ * @return the clamped value
+ */
+static size_t clamp_size(size_t value, size_t low, size_t high) {
+  return value < low ? low : value > high ? high : value;
+}
+
+/**
+ * Maps the index of a tap along a row or column onto the image.
+ * @param index the index, possibly outside [0, length)
+ * @param length the length of the row or column
+ * @param border the border mode
+ * @param mapped where to store the index of the pixel the tap reads
+ * @return false if the tap reads nothing
+ */
+static bool border_index(ptrdiff_t index, size_t length, border_mode border,
+                         size_t *mapped) {
+  const ptrdiff_t last = (ptrdiff_t) length - 1;
+
+  if (index >= 0 && index <= last) {
+    *mapped = (size_t) index;
+    return true;
+  }
+  switch (border) {
+    case BORDER_CLAMP:
+      *mapped = index < 0 ? 0 : (size_t) last;
+      return true;
+    case BORDER_MIRROR: {
+      // reflect back and forth until the index lands in the image, so even
+      // kernels wider than the image read a pixel of it
+      const ptrdiff_t period = 2 * last;
+      if (period == 0) {
+        *mapped = 0;
+        return true;
+      }
+      index %= period;
+      if (index < 0) index += period;
+      *mapped = (size_t) (index > last ? period - index : index);
+      return true;
+    }
+    case BORDER_ZERO:
+    case BORDER_RENORMALIZE:
+      break;
+  }
+  return false;
+}
+
+/**
+ * Convolves one pixel whose window may leave the image, mapping every tap
+ * through the kernel's border mode. Taps are summed in the same order as
+ * the interior loop, so a tap inside the image costs the same rounding.
+ * @param image the image
+ * @param kernel the kernel
+ * @param row the row of the pixel
+ * @param col the column of the pixel
+ * @return the convolved pixel
+ */
+static Pixel convolve_border(const Image *image,
+                             const ConvolutionKernel *kernel,
+                             size_t row,
+                             size_t col) {
+  const ptrdiff_t radius = (ptrdiff_t) (kernel->size / 2);
+  const float *weights = kernel->weights;
+  float b = 0, g = 0, r = 0;
+  float in_weight = 0; // sum of the weights of the taps that read a pixel
+  size_t y, x;
+
+  for (size_t ky = 0; ky < kernel->size; ++ky) {
+    if (!border_index((ptrdiff_t) (row + ky) - radius,
+                      (size_t) image->height, kernel->border, &y)) {
+      continue;
+    }
+    const Pixel *src = pixel_buffer_row(&image->pixels, y);
+    for (size_t kx = 0; kx < kernel->size; ++kx) {
+      if (!border_index((ptrdiff_t) (col + kx) - radius,
+                        (size_t) image->width, kernel->border, &x)) {
+        continue;
+      }
+      const float w = weights[ky * kernel->size + kx];
+      b += w * src[x].b;
+      g += w * src[x].g;
+      r += w * src[x].r;
+      in_weight += w;
+    }
+  }
+  // a kernel whose in-bounds weights cancel out, e.g. an edge detector's,
+  // cannot be scaled up: leave it as zero padding would
+  if (kernel->border == BORDER_RENORMALIZE && in_weight != 0) {
+    const float scale = kernel->total / in_weight;
+    b *= scale;
+    g *= scale;
+    r *= scale;
+  }
+  return (Pixel) {
+    .b = saturate(b),
+    .g = saturate(g),
+    .r = saturate(r),
+  };
+}
+
+/**
+ * Convolves pixels whose windows lie inside the image: no tap is checked.
+ * Inlined into a copy per common size, whose tap loops have constant bounds
+ * and unroll.
+ * @param rows the image rows the windows cover, top to bottom
+ * @param weights the kernel's weights
+ * @param size the kernel's side
+ * @param from the first column
+ * @param to the column after the last
+ * @param dst where to write pixel from
+ */
+static ALWAYS_INLINE void convolve_interior(const Pixel *const *rows,
+                                            const float *weights,
+                                            size_t size,
+                                            size_t from,
+                                            size_t to,
+                                            Pixel *dst) {
+  const size_t radius = size / 2;
+
+  for (size_t x = from; x < to; ++x) {
+    float b = 0, g = 0, r = 0;
+    for (size_t ky = 0; ky < size; ++ky) {
+      const Pixel *src = rows[ky] + x - radius;
+      const float *w = weights + ky * size;
+      for (size_t kx = 0; kx < size; ++kx) {
+        b += w[kx] * src[kx].b;
+        g += w[kx] * src[kx].g;
+        r += w[kx] * src[kx].r;
+      }
+    }
+    *dst++ = (Pixel) {
+      .b = saturate(b),
+      .g = saturate(g),
+      .r = saturate(r),
+    };
+  }
+}
+
+/**
+ * convolve_interior for 3x3 kernels.
+ */
+static void convolve_interior_3(const Pixel *const *rows, const float *weights,
+                                size_t size, size_t from, size_t to,
+                                Pixel *dst) {
+  (void) size;
+  convolve_interior(rows, weights, 3, from, to, dst);
+}
+
+/**
+ * convolve_interior for 5x5 kernels.
+ */
+static void convolve_interior_5(const Pixel *const *rows, const float *weights,
+                                size_t size, size_t from, size_t to,
+                                Pixel *dst) {
+  (void) size;
+  convolve_interior(rows, weights, 5, from, to, dst);
+}
+
+/**
+ * convolve_interior for 7x7 kernels.
+ */
+static void convolve_interior_7(const Pixel *const *rows, const float *weights,
+                                size_t size, size_t from, size_t to,
+                                Pixel *dst) {
+  (void) size;
+  convolve_interior(rows, weights, 7, from, to, dst);
+}
+
+/**
+ * convolve_interior for kernels of any size.
+ */
+static void convolve_interior_any(const Pixel *const *rows,
+                                  const float *weights,
+                                  size_t size, size_t from, size_t to,
+                                  Pixel *dst) {
+  convolve_interior(rows, weights, size, from, to, dst);
+}
+
+/**
+ * Picks the interior loop for a kernel size.
+ * @param size the kernel's side
+ * @return the loop
+ */
+static interior_method interior_for(size_t size) {
+  switch (size) {
+    case 3:
+      return convolve_interior_3;
+    case 5:
+      return convolve_interior_5;
+    case 7:
+      return convolve_interior_7;
+    default:
+      return convolve_interior_any;
+  }
+}
@@ -0,0 +1,285 @@
+#include "../headers/Gaussian.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include "../headers/macros.h"
+#include "../headers/Partition.h"
+
+// rows transposed together: a tile's column is 16 values, half a cache line
+#define GAUSSIAN_TILE 16
+// columns copied out together
+#define GAUSSIAN_BLOCK 64
+// fraction bits of the blurred values
+#define FIXED_SHIFT 8
+
+/**
+ * A build pass, split into bands of rows or stripes of columns.
+ */
+typedef struct {
+  const Image *image; // the image being blurred
+  GaussianImage *blur; // the blur being built
+} GaussianJob;
+
+// helper functions
+static void box_radii(double sigma, size_t radii[GAUSSIAN_BOXES]);
+
+static void box_pass(const uint16_t *src, uint16_t *dst, size_t length,
+                     size_t radius);
+
+static void box_passes(const size_t radii[GAUSSIAN_BOXES],
+                       const uint16_t *src, uint16_t *dst,
+                       uint16_t *work[2], size_t length);
+
+static void rows_task(void *context, size_t index);
+
+static void columns_task(void *context, size_t index);
+
+size_t gaussian_radius(double sigma) {
+  size_t radii[GAUSSIAN_BOXES];
+  size_t radius = 0;
+
+  box_radii(sigma, radii);
+  for (size_t k = 0; k < GAUSSIAN_BOXES; ++k) radius += radii[k];
+  return radius;
+}
+
+int gaussian_image_create(GaussianImage *blur, size_t width, size_t height,
+                          double sigma, size_t parts) {
+  // a row task holds a tile of rows and two lines; a column task two
+  // columns
+  const size_t row_scratch = 3 * (GAUSSIAN_TILE + 2) * width;
+  const size_t column_scratch = 3 * 2 * height;
+
+  *blur = (GaussianImage) {0};
+  box_radii(sigma, blur->radii);
+  MALLOC(blur->columns, sizeof(uint16_t) * 3 * width * height, fail);
+  blur->scratch_size = row_scratch > column_scratch ? row_scratch
+                                                    : column_scratch;
+  MALLOC(blur->scratch, sizeof(uint16_t) * blur->scratch_size * parts, fail);
+  blur->width = width;
+  blur->height = height;
+  blur->stride = 3 * height;
+  blur->parts = parts;
+  return EXIT_SUCCESS;
+
+fail:
+  gaussian_image_destroy(blur);
+  return EXIT_FAILURE;
+}
+
+void gaussian_image_destroy(GaussianImage *blur) {
+  FREE(blur->columns);
+  FREE(blur->scratch);
+  *blur = (GaussianImage) {0};
+}
+
+void gaussian_image_build(ThreadPool *pool, const Image *image,
+                          GaussianImage *blur) {
+  GaussianJob job = {
+    .image = image,
+    .blur = blur,
+  };
+
+  blur->height = (size_t) image->height;
+  thread_pool_run(pool, rows_task, &job, blur->parts);
+  thread_pool_run(pool, columns_task, &job, blur->parts);
+}
+
+void *image_apply_t_gaussian(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const GaussianImage *blur = thread_data->gaussian;
+
+  // blocks of columns, each copied out a tile of rows at a time: the
+  // block's columns stay in the TLB and caches all the way down
+  for (size_t j0 = 0; j0 < thread_data->width; j0 += GAUSSIAN_BLOCK) {
+    const size_t block_end = thread_data->width - j0 < GAUSSIAN_BLOCK
+                               ? thread_data->width
+                               : j0 + GAUSSIAN_BLOCK;
+    for (size_t i = 0; i < thread_data->height; i += GAUSSIAN_TILE) {
+      const size_t tile_rows = thread_data->height - i < GAUSSIAN_TILE
+                                 ? thread_data->height - i
+                                 : GAUSSIAN_TILE;
+      rgb_value *rows[GAUSSIAN_TILE];
+      for (size_t t = 0; t < tile_rows; ++t) {
+        rows[t] = (rgb_value *) pixel_buffer_row(&thread_data->thread_pixels,
+                                                 i + t);
+      }
+      // each column of the tile is a contiguous run of a blurred column
+      for (size_t j = j0; j < block_end; ++j) {
+        const uint16_t *column =
+            blur->columns + (thread_data->start + j) * blur->stride +
+            3 * (thread_data->row_start + i);
+        for (size_t t = 0; t < tile_rows; ++t) {
+          for (size_t c = 0; c < 3; ++c) {
+            rows[t][3 * j + c] = (rgb_value) (
+              (column[3 * t + c] + (1u << (FIXED_SHIFT - 1))) >> FIXED_SHIFT);
+          }
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Picks the widths of GAUSSIAN_BOXES box passes, each one of two consecutive
+ * odd widths, whose variances add up as closely as possible to sigma^2.
+ * @param sigma the standard deviation of the Gaussian
+ * @param radii where to store the radius of each pass
+ */
+static void box_radii(double sigma, size_t radii[GAUSSIAN_BOXES]) {
+  const double variance = 12 * sigma * sigma;
+  const double ideal = sqrt(variance / GAUSSIAN_BOXES + 1);
+  long lower = (long) floor(ideal);
+  if (lower % 2 == 0) --lower;
+  // how many passes use the lower width
+  long lower_count = lround(
+      (variance - GAUSSIAN_BOXES * (double) (lower * lower + 4 * lower + 3)) /
+      (-4.0 * (double) lower - 4));
+  if (lower_count < 0) lower_count = 0;
+
+  for (long k = 0; k < GAUSSIAN_BOXES; ++k) {
+    radii[k] = (size_t) ((k < lower_count ? lower : lower + 2) - 1) / 2;
+  }
+}
+
+/**
+ * Box-filters a line of pixels in 8.8 fixed point with a running sum per
+ * channel: each value becomes the rounded mean of the in-bounds values of
+ * its channel within radius of it.
+ * @param src the line, 3 values per pixel
+ * @param dst where to write the filtered line, not src
+ * @param length the number of pixels
+ * @param radius the radius of the box
+ */
+static void box_pass(const uint16_t *src, uint16_t *dst, size_t length,
+                     size_t radius) {
+  const uint32_t full = (uint32_t) (2 * radius + 1);
+  // x / full == (x * inverse) >> 40 for every rounded sum x: x / full fits
+  // in 16 bits and the error of inverse is less than full, so it never
+  // carries into the quotient
+  const uint64_t inverse = ((1ull << 40) + full - 1) / full;
+  // from pixel radius to pixel end_full - 1, windows are whole and slide
+  // without leaving the line: no division and no bounds checks
+  const size_t end_full = length > 2 * radius + 1 ? length - radius - 1 : 0;
+  // one sum per channel: independent, so their additions overlap
+  uint32_t sum0 = 0, sum1 = 0, sum2 = 0;
+  size_t low = 0, high = 0; // the window is [low, high)
+  size_t j = 0;
+
+  for (; high < length && high <= radius; ++high) {
+    sum0 += src[3 * high];
+    sum1 += src[3 * high + 1];
+    sum2 += src[3 * high + 2];
+  }
+  for (; j < length; ++j) {
+    if (j == radius) {
+      for (; j < end_full; ++j) {
+        dst[3 * j] = (uint16_t) (((sum0 + full / 2) * inverse) >> 40);
+        dst[3 * j + 1] = (uint16_t) (((sum1 + full / 2) * inverse) >> 40);
+        dst[3 * j + 2] = (uint16_t) (((sum2 + full / 2) * inverse) >> 40);
+        sum0 += src[3 * high] - src[3 * low];
+        sum1 += src[3 * high + 1] - src[3 * low + 1];
+        sum2 += src[3 * high + 2] - src[3 * low + 2];
+        ++high;
+        ++low;
+      }
+    }
+    const uint32_t count = (uint32_t) (high - low);
+    dst[3 * j] = (uint16_t) ((sum0 + count / 2) / count);
+    dst[3 * j + 1] = (uint16_t) ((sum1 + count / 2) / count);
+    dst[3 * j + 2] = (uint16_t) ((sum2 + count / 2) / count);
+    if (high < length) {
+      sum0 += src[3 * high];
+      sum1 += src[3 * high + 1];
+      sum2 += src[3 * high + 2];
+      ++high;
+    }
+    if (j >= radius) {
+      sum0 -= src[3 * low];
+      sum1 -= src[3 * low + 1];
+      sum2 -= src[3 * low + 2];
+      ++low;
+    }
+  }
+}
+
+/**
+ * Runs the box passes over a line.
+ * @param radii the radius of each pass
+ * @param src the line
+ * @param dst where to write the blurred line; may be src
+ * @param work two lines of scratch, neither of them dst
+ * @param length the number of pixels
+ */
+static void box_passes(const size_t radii[GAUSSIAN_BOXES],
+                       const uint16_t *src, uint16_t *dst,
+                       uint16_t *work[2], size_t length) {
+  const uint16_t *in = src;
+
+  for (size_t k = 0; k < GAUSSIAN_BOXES; ++k) {
+    uint16_t *out = k + 1 == GAUSSIAN_BOXES ? dst : work[k % 2];
+    box_pass(in, out, length, radii[k]);
+    in = out;
+  }
+}
+
+/**
+ * Task: blur the rows of one row band and write them transposed into the
+ * columns, GAUSSIAN_TILE rows at a time so every column gets a run of values.
+ * @param context the GaussianJob
+ * @param index the index of the row band
+ */
+static void rows_task(void *context, size_t index) {
+  const GaussianJob *job = (GaussianJob *) context;
+  const GaussianImage *blur = job->blur;
+  const size_t width = blur->width;
+  uint16_t *tile = blur->scratch + index * blur->scratch_size;
+  uint16_t *line = tile + 3 * GAUSSIAN_TILE * width;
+  // the input line is free for scratch once the first pass has read it
+  uint16_t *work[2] = {line + 3 * width, line};
+  size_t first_row, rows;
+
+  partition_split(blur->height, blur->parts, index, &first_row, &rows);
+  for (size_t y = first_row; y < first_row + rows; y += GAUSSIAN_TILE) {
+    const size_t tile_rows = first_row + rows - y < GAUSSIAN_TILE
+                               ? first_row + rows - y
+                               : GAUSSIAN_TILE;
+    for (size_t t = 0; t < tile_rows; ++t) {
+      const rgb_value *src =
+          (const rgb_value *) pixel_buffer_row(&job->image->pixels, y + t);
+      for (size_t x = 0; x < 3 * width; ++x) {
+        line[x] = (uint16_t) (src[x] << FIXED_SHIFT);
+      }
+      box_passes(blur->radii, line, tile + 3 * t * width, work, width);
+    }
+    for (size_t x = 0; x < width; ++x) {
+      uint16_t *column = blur->columns + x * blur->stride + 3 * y;
+      for (size_t t = 0; t < tile_rows; ++t) {
+        for (size_t c = 0; c < 3; ++c) {
+          column[3 * t + c] = tile[3 * (t * width + x) + c];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Task: blur the columns of one column stripe in place; each is contiguous.
+ * @param context the GaussianJob
+ * @param index the index of the column stripe
+ */
+static void columns_task(void *context, size_t index) {
+  const GaussianJob *job = (GaussianJob *) context;
+  const GaussianImage *blur = job->blur;
+  uint16_t *scratch = blur->scratch + index * blur->scratch_size;
+  uint16_t *work[2] = {scratch, scratch + 3 * blur->height};
+  size_t first_col, cols;
+
+  partition_split(blur->width, blur->parts, index, &first_col, &cols);
+  for (size_t x = first_col; x < first_col + cols; ++x) {
+    uint16_t *column = blur->columns + x * blur->stride;
+    box_passes(blur->radii, column, column, work, blur->height);
+  }
+}
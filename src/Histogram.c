@@ -0,0 +1,204 @@
+#include "../headers/Histogram.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "../headers/Lut.h"
+#include "../headers/macros.h"
+#include "../headers/Partition.h"
+
+// auto-levels ignores 1 in this many pixels at either end of a channel
+#define AUTOLEVELS_CLIP 200
+// histograms a task counts consecutive pixels into, so that runs of equal
+// pixels do not wait on the same counter
+#define COUNT_WAYS 4
+
+static_assert(sizeof(Histogram) % PIXEL_BUFFER_ALIGNMENT == 0,
+              "Histograms must not share cache lines");
+
+/**
+ * A gathering of an image's histogram: a counting pass split into bands of
+ * rows, each with a histogram of its own, then rounds adding them up.
+ */
+typedef struct {
+  const Image *image; // the image being counted
+  Histogram *histograms; // one per band
+  size_t parts; // number of bands the counting pass is split into
+  size_t step; // distance between the histograms a round adds up
+} HistogramJob;
+
+// helper functions
+static void count_task(void *context, size_t index);
+
+static void reduce_task(void *context, size_t index);
+
+static void identity_table(rgb_value *table);
+
+static void autolevels_table(const uint32_t *counts, uint64_t total,
+                             rgb_value *table);
+
+static void equalize_table(const uint32_t *counts, uint64_t total,
+                           rgb_value *table);
+
+int histogram_gather(ThreadPool *pool, const Image *image,
+                     Histogram *histogram) {
+  HistogramJob job = {
+    .image = image,
+    .parts = thread_pool_size(pool),
+  };
+
+  ALIGNED_ALLOC(job.histograms, PIXEL_BUFFER_ALIGNMENT,
+                sizeof(Histogram) * job.parts, fail);
+  thread_pool_run(pool, count_task, &job, job.parts);
+  // a round adds histogram i + step into histogram i for every multiple i of
+  // 2 * step; the pool finishes a round before starting the next, so the
+  // histograms a round reads are complete
+  for (job.step = 1; job.step < job.parts; job.step *= 2) {
+    thread_pool_run(pool, reduce_task, &job,
+                    (job.parts + job.step - 1) / (2 * job.step));
+  }
+  *histogram = job.histograms[0];
+  FREE(job.histograms);
+  return EXIT_SUCCESS;
+
+fail:
+  return EXIT_FAILURE;
+}
+
+void histogram_lut(const Histogram *histogram, histogram_op op, Lut *lut) {
+  const uint32_t *counts[] = {histogram->b, histogram->g, histogram->r};
+  rgb_value *tables[] = {lut->b, lut->g, lut->r};
+  uint64_t total = 0;
+
+  for (size_t v = 0; v <= UCHAR_MAX; ++v) total += histogram->b[v];
+  for (size_t c = 0; c < 3; ++c) {
+    if (op == HISTOGRAM_AUTOLEVELS) {
+      autolevels_table(counts[c], total, tables[c]);
+    } else {
+      equalize_table(counts[c], total, tables[c]);
+    }
+  }
+}
+
+void *image_apply_t_histogram(void *data) {
+  // the tables were derived before the pass, so what is left is a lookup
+  return image_apply_t_lut(data);
+}
+
+/**
+ * Task: count one band of rows into the band's histogram.
+ * @param context the HistogramJob
+ * @param index the index of the band
+ */
+static void count_task(void *context, size_t index) {
+  const HistogramJob *job = (HistogramJob *) context;
+  const Image *image = job->image;
+  const size_t width = (size_t) image->width;
+  Histogram *histogram = &job->histograms[index];
+  Histogram ways[COUNT_WAYS] = {0};
+  size_t first, rows;
+
+  partition_split((size_t) image->height, job->parts, index, &first, &rows);
+  for (size_t y = first; y < first + rows; ++y) {
+    const Pixel *src = pixel_buffer_row(&image->pixels, y);
+    size_t x = 0;
+    for (; x + COUNT_WAYS <= width; x += COUNT_WAYS) {
+      for (size_t k = 0; k < COUNT_WAYS; ++k) {
+        ++ways[k].b[src[x + k].b];
+        ++ways[k].g[src[x + k].g];
+        ++ways[k].r[src[x + k].r];
+      }
+    }
+    for (; x < width; ++x) {
+      ++ways[0].b[src[x].b];
+      ++ways[0].g[src[x].g];
+      ++ways[0].r[src[x].r];
+    }
+  }
+  // written by its own task, so its pages are local to the thread counting
+  for (size_t v = 0; v <= UCHAR_MAX; ++v) {
+    histogram->b[v] = histogram->g[v] = histogram->r[v] = 0;
+    for (size_t k = 0; k < COUNT_WAYS; ++k) {
+      histogram->b[v] += ways[k].b[v];
+      histogram->g[v] += ways[k].g[v];
+      histogram->r[v] += ways[k].r[v];
+    }
+  }
+}
+
+/**
+ * Task: add one histogram of a round's pairs into the other.
+ * @param context the HistogramJob
+ * @param index the index of the pair
+ */
+static void reduce_task(void *context, size_t index) {
+  const HistogramJob *job = (HistogramJob *) context;
+  Histogram *into = &job->histograms[2 * job->step * index];
+  const Histogram *from = into + job->step;
+
+  for (size_t v = 0; v <= UCHAR_MAX; ++v) {
+    into->b[v] += from->b[v];
+    into->g[v] += from->g[v];
+    into->r[v] += from->r[v];
+  }
+}
+
+/**
+ * Fills a channel's table with the identity map.
+ * @param table the table
+ */
+static void identity_table(rgb_value *table) {
+  for (size_t v = 0; v <= UCHAR_MAX; ++v) table[v] = (rgb_value) v;
+}
+
+/**
+ * Fills a channel's table with the stretch that auto-levels applies.
+ * @param counts the channel's histogram
+ * @param total the number of pixels
+ * @param table the table
+ */
+static void autolevels_table(const uint32_t *counts, uint64_t total,
+                             rgb_value *table) {
+  const uint64_t clip = total / AUTOLEVELS_CLIP;
+  uint64_t below = 0, above = 0;
+  int black = 0, white = UCHAR_MAX;
+  Lut levels;
+
+  // the first values with more than clip pixels at or beyond them
+  while (black < UCHAR_MAX && (below += counts[black]) <= clip) ++black;
+  while (white > 0 && (above += counts[white]) <= clip) --white;
+  if (white <= black) {
+    identity_table(table);
+    return;
+  }
+  lut_levels(&levels, black, white);
+  memcpy(table, levels.b, sizeof(levels.b));
+}
+
+/**
+ * Fills a channel's table with the map that equalizes its histogram.
+ * @param counts the channel's histogram
+ * @param total the number of pixels
+ * @param table the table
+ */
+static void equalize_table(const uint32_t *counts, uint64_t total,
+                           rgb_value *table) {
+  uint64_t smallest = 0; // pixels of the smallest value present
+  uint64_t cumulative = 0;
+
+  for (size_t v = 0; v <= UCHAR_MAX && smallest == 0; ++v) {
+    smallest = counts[v];
+  }
+  if (smallest == total) {
+    identity_table(table);
+    return;
+  }
+  for (size_t v = 0; v <= UCHAR_MAX; ++v) {
+    cumulative += counts[v];
+    table[v] = (rgb_value) (cumulative <= smallest
+                              ? 0
+                              : ((cumulative - smallest) * UCHAR_MAX +
+                                 (total - smallest) / 2) /
+                                (total - smallest));
+  }
+}
@@ -6,54 +6,109 @@
 #include <time.h>
 #include <limits.h>
 #include <sys/errno.h>
-
+#include <sys/mman.h>
+
+#include "../headers/Cheese.h"
+#include "../headers/Convolve.h"
+#include "../headers/Gaussian.h"
+#include "../headers/Histogram.h"
+#include "../headers/Integral.h"
+#include "../headers/Lut.h"
 #include "../headers/macros.h"
+#include "../headers/Median.h"
+#include "../headers/Orient.h"
+#include "../headers/Planar.h"
+#include "../headers/Resize.h"
+#include "../headers/Simd.h"
 
 // helper functions
-static int generate_radius(int min_dimension);
-
-static bool pixel_in_bounds(const Image *img, int row, int col);
-
 static unsigned char clamp_to_pixel(int value);
 
-static void flood_fill(Image *img,
-                       int h,
-                       int k,
-                       int radius,
-                       int x,
-                       int y);
-
-Pixel **create_pixel_array_2d(size_t width, size_t height) {
-  Pixel **pixels = nullptr;
-  MALLOC_2D(pixels, height, width, Pixel, fail);
-  // initialize to 0 pixels
-  for (size_t i = 0; i < height; ++i) {
-    for (size_t j = 0; j < width; ++j) {
-      pixels[i][j].r = 0;
-      pixels[i][j].g = 0;
-      pixels[i][j].b = 0;
-    }
+/** Allocates an uninitialized pixel buffer as a single cache-line-aligned
+ * block whose rows are padded to a multiple of the cache line size.
+ *
+ * @param  buffer: the buffer to initialize.
+ * @param  width: Width of the buffer in pixels.
+ * @param  height: Height of the buffer in pixels.
+ * @param  huge_pages: Align large buffers to huge pages and advise the kernel
+ *         to back them with huge pages where supported.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int pixel_buffer_create(PixelBuffer *buffer, size_t width, size_t height,
+                        bool huge_pages) {
+  void *data = nullptr;
+  // pad rows so that every row starts on its own cache line
+  const size_t stride = (sizeof(Pixel) * width + PIXEL_BUFFER_ALIGNMENT - 1) /
+                        PIXEL_BUFFER_ALIGNMENT * PIXEL_BUFFER_ALIGNMENT;
+  const size_t size = stride * height;
+  const bool use_huge_pages = huge_pages && size >= HUGE_PAGE_SIZE;
+
+  if (width == 0 || height == 0) {
+    errno = EINVAL;
+    perror("pixel_buffer_create: zero dimension");
+    return EXIT_FAILURE;
+  }
+
+  // no zero fill: every pixel is written before it is read, and readPixels
+  // clears the rows it fails to read
+  ALIGNED_ALLOC(data,
+                use_huge_pages ? HUGE_PAGE_SIZE : PIXEL_BUFFER_ALIGNMENT,
+                size,
+                fail);
+#ifdef MADV_HUGEPAGE
+  if (use_huge_pages) {
+    madvise(data, size, MADV_HUGEPAGE);
   }
-  return pixels;
+#endif
+
+  buffer->data = data;
+  buffer->stride = stride;
+  buffer->width = width;
+  buffer->height = height;
+  buffer->owned = true;
+  return EXIT_SUCCESS;
 fail:
-  return nullptr;
+  return EXIT_FAILURE;
 }
 
-void free_pixel_array_2d(Pixel **array, size_t height) {
-  for (size_t i = 0; i < height; ++i) {
-    FREE(array[i]);
+/** Returns a view onto pixels owned elsewhere.
+ *
+ * @param  data: First pixel of row 0.
+ * @param  stride: Bytes between the starts of consecutive rows.
+ * @param  width: Width of the view in pixels.
+ * @param  height: Height of the view in pixels.
+ */
+PixelBuffer pixel_buffer_view(Pixel *data, size_t stride, size_t width,
+                              size_t height) {
+  return (PixelBuffer) {
+    .data = data,
+    .stride = stride,
+    .width = width,
+    .height = height,
+    .owned = false,
+  };
+}
+
+/** Frees an owned pixel buffer; views are only cleared.
+ *
+ * @param  buffer: the buffer to free.
+ */
+void pixel_buffer_destroy(PixelBuffer *buffer) {
+  if (buffer->owned) {
+    FREE(buffer->data);
   }
-  FREE(array);
+  *buffer = (PixelBuffer) {0};
 }
 
-/** Creates a new image and returns it.
-*
-* @param  pArr: Pixel array of this image.
-* @param  width: Width of this image.
-* @param  height: Height of this image.
-* @return A pointer to a new image.
-*/
-Image *image_create(Pixel **pArr, int32_t width, int32_t height) {
+/** Creates a new image and returns it. The image takes ownership of the
+ * pixel buffer (views stay owned by their owner).
+ *
+ * @param  pixels: Pixel buffer of this image.
+ * @param  width: Width of this image.
+ * @param  height: Height of this image.
+ * @return A pointer to a new image.
+ */
+Image *image_create(const PixelBuffer *pixels, int32_t width, int32_t height) {
   Image *img = nullptr;
 
   if ((img = malloc(sizeof(Image))) == nullptr) {
@@ -64,7 +119,7 @@ Image *image_create(Pixel **pArr, int32_t width, int32_t height) {
   // initialize new Image
   img->height = height;
   img->width = width;
-  img->pixel_array = pArr;
+  img->pixels = *pixels;
 
   // return pointer to new Image
   return img;
@@ -76,16 +131,16 @@ Image *image_create(Pixel **pArr, int32_t width, int32_t height) {
  * @param  img: the image to destroy.
  */
 void image_destroy(Image **img) {
-  // free the pixel array
-  free_pixel_array_2d((*img)->pixel_array, (size_t) (*img)->height);
+  // free the pixel buffer (views are owned elsewhere)
+  pixel_buffer_destroy(&(*img)->pixels);
   // free the image
   FREE(*img);
 }
 
-/** Returns a double pointer to the pixel array.
+/** Returns a pointer to the pixel buffer.
  * @param  img: the image.
  */
-Pixel **image_get_pixels(const Image *img) { return img->pixel_array; }
+PixelBuffer *image_get_pixels(Image *img) { return &img->pixels; }
 
 /** Returns the width of the image.
  *
@@ -107,166 +162,347 @@ void image_apply_cheese(Image *img) {
   // tint the image yellow ;P
   // image_apply_bw(img);
   // image_apply_colorshift(img, 150, 150, 0);
-  const int32_t MIN_DIM = (img->width < img->height) ? img->width : img->height;
-  const int32_t HOLE_COUNT = (int32_t) (MIN_DIM * 0.08);
-
-  srand((unsigned) time(nullptr));
-  for (int32_t i = 0; i < HOLE_COUNT; ++i) {
-    // pick random center points (h,k)
-    const int32_t h = rand() % MIN_DIM;
-    const int32_t k = rand() % MIN_DIM;
-    // for each center point, generate a random radius
-    const int32_t radius = generate_radius(MIN_DIM);
-    // flood fill from center to fill the circle
-    flood_fill(img, h, k, radius, h, k);
+  CheeseHoles holes;
+
+  if (cheese_holes_create(&holes, (size_t) img->width, (size_t) img->height,
+                          (uint64_t) time(nullptr)) != EXIT_SUCCESS) {
+    return;
   }
+  cheese_holes_paint(&holes, &img->pixels, 0, 0);
+  cheese_holes_destroy(&holes);
   printf("swiss cheese applied\n");
 }
 
 void *image_apply_t_colorshift(void *data) {
   const ThreadData *thread_data = (ThreadData *) data;
 
-  Pixel **read_pixels = thread_data->og_image->pixel_array;
-  Pixel **write_pixels = thread_data->thread_pixel_array;
+  const PixelBuffer *read_pixels = &thread_data->og_image->pixels;
+  const PixelBuffer *write_pixels = &thread_data->thread_pixels;
 
   for (size_t i = 0; i < thread_data->height; ++i) {
-    for (size_t j = thread_data->start; j <= thread_data->end; ++j) {
-      write_pixels[i][j - thread_data->start].r =
-          clamp_to_pixel(read_pixels[i][j].r + thread_data->rShift);
-      write_pixels[i][j - thread_data->start].g =
-          clamp_to_pixel(read_pixels[i][j].g + thread_data->gShift);
-      write_pixels[i][j - thread_data->start].b =
-          clamp_to_pixel(read_pixels[i][j].b + thread_data->bShift);
-    }
+    const Pixel *src = pixel_buffer_row(read_pixels, thread_data->row_start + i)
+                       + thread_data->start;
+    Pixel *dst = pixel_buffer_row(write_pixels, i);
+    simd_colorshift_row(src, dst, thread_data->width, thread_data->rShift,
+                        thread_data->gShift, thread_data->bShift);
   }
-  pthread_exit(nullptr);
+  return nullptr;
+}
+
+Pixel image_pixel_colorshift(Pixel pixel, const ThreadData *data) {
+  return (Pixel) {
+    .r = clamp_to_pixel(pixel.r + data->rShift),
+    .g = clamp_to_pixel(pixel.g + data->gShift),
+    .b = clamp_to_pixel(pixel.b + data->bShift),
+  };
 }
 
 void *image_apply_t_bw(void *data) {
   const ThreadData *thread_data = (ThreadData *) data;
 
-  Pixel **read_pixels = thread_data->og_image->pixel_array;
-  Pixel **write_pixels = thread_data->thread_pixel_array;
+  const PixelBuffer *read_pixels = &thread_data->og_image->pixels;
+  const PixelBuffer *write_pixels = &thread_data->thread_pixels;
 
-  for (size_t i = 0; i < (size_t) thread_data->height; ++i) {
-    for (size_t j = thread_data->start; j <= thread_data->end; ++j) {
-      const rgb_value GRAYSCALE_VALUE = (rgb_value) (
-        (0.299 * read_pixels[i][j].r) +
-        (0.587 * read_pixels[i][j].g) +
-        (0.114 * read_pixels[i][j].b));
-
-      // set each RGB component to the calculated grayscale value
-      write_pixels[i][j - thread_data->start].r = GRAYSCALE_VALUE;
-      write_pixels[i][j - thread_data->start].g = GRAYSCALE_VALUE;
-      write_pixels[i][j - thread_data->start].b = GRAYSCALE_VALUE;
-    }
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const Pixel *src = pixel_buffer_row(read_pixels, thread_data->row_start + i)
+                       + thread_data->start;
+    Pixel *dst = pixel_buffer_row(write_pixels, i);
+    simd_bw_row(src, dst, thread_data->width);
   }
-  pthread_exit(nullptr);
+  return nullptr;
 }
 
-void *image_apply_t_cheese(void *data) {
-  // TODO: implement this
+Pixel image_pixel_bw(Pixel pixel, const ThreadData *data) {
   (void) data;
-  pthread_exit(nullptr);
+  const rgb_value GRAYSCALE_VALUE = pixel_gray(pixel.r, pixel.g, pixel.b);
+
+  // set each RGB component to the calculated grayscale value
+  return (Pixel) {
+    .b = GRAYSCALE_VALUE,
+    .g = GRAYSCALE_VALUE,
+    .r = GRAYSCALE_VALUE,
+  };
 }
 
 void *image_apply_t_boxblur(void *data) {
-  const ThreadData *thread_data = (ThreadData *) data;
+  ThreadData *thread_data = (ThreadData *) data;
 
   // Validate input parameters
   if (!thread_data || !thread_data->og_image ||
-      !thread_data->og_image->pixel_array || !thread_data->thread_pixel_array) {
+      !thread_data->og_image->pixels.data || !thread_data->thread_pixels.data) {
     fprintf(stderr, "Invalid thread data or image pointers\n");
-    pthread_exit(nullptr);
+    return nullptr;
+  }
+  if (thread_data->height == 0) return nullptr;
+
+  const PixelBuffer *og_pixels = &thread_data->og_image->pixels;
+  const size_t radius = thread_data->blur_radius;
+  const size_t image_width = (size_t) thread_data->og_image->width;
+  const size_t image_height = (size_t) thread_data->og_image->height;
+  // columns the thread's neighborhoods reach, clipped to the image
+  const size_t lo = thread_data->start > radius
+                      ? thread_data->start - radius
+                      : 0;
+  const size_t hi = thread_data->end + radius < image_width
+                      ? thread_data->end + radius
+                      : image_width - 1;
+  const size_t span = hi - lo + 1;
+  unsigned *column_sums = nullptr;
+
+  MALLOC(column_sums, sizeof(unsigned) * 3 * span, fail);
+  unsigned *r_sums = column_sums;
+  unsigned *g_sums = column_sums + span;
+  unsigned *b_sums = column_sums + 2 * span;
+
+  // Vertical window of the first row: sum its rows for every column reached
+  size_t first_row = thread_data->row_start > radius
+                       ? thread_data->row_start - radius
+                       : 0;
+  size_t last_row = thread_data->row_start + radius < image_height
+                      ? thread_data->row_start + radius
+                      : image_height - 1;
+  for (size_t x = 0; x < span; ++x) {
+    r_sums[x] = g_sums[x] = b_sums[x] = 0;
+  }
+  for (size_t y = first_row; y <= last_row; ++y) {
+    const Pixel *src = pixel_buffer_row(og_pixels, y) + lo;
+    for (size_t x = 0; x < span; ++x) {
+      r_sums[x] += src[x].r;
+      g_sums[x] += src[x].g;
+      b_sums[x] += src[x].b;
+    }
   }
-
-  Pixel **og_pixels = thread_data->og_image->pixel_array;
-  Pixel **new_pixels = thread_data->thread_pixel_array;
 
   // Process each pixel in thread's section
-  for (size_t row = 0; row < thread_data->height; ++row) {
-    for (size_t col = thread_data->start; col <= thread_data->end; ++col) {
-      int rSum = 0, gSum = 0, bSum = 0;
-      int valid_neighbors = 0;
-
-      // Process the neighborhood of the current pixel
-      int half_kernel = KERNEL_SIZE / 2;
-      for (int i = -half_kernel; i <= half_kernel; ++i) {
-        for (int j = -half_kernel; j <= half_kernel; ++j) {
-          int row_offset = (int) row + i;
-          int col_offset = (int) col + j;
-
-          if (pixel_in_bounds(thread_data->og_image, row_offset, col_offset)) {
-            ++valid_neighbors;
-            rSum += og_pixels[row_offset][col_offset].r;
-            gSum += og_pixels[row_offset][col_offset].g;
-            bSum += og_pixels[row_offset][col_offset].b;
-          }
+  for (size_t out_row = 0; out_row < thread_data->height; ++out_row) {
+    const size_t row = thread_data->row_start + out_row;
+    Pixel *new_pixels = pixel_buffer_row(&thread_data->thread_pixels, out_row);
+
+    // slide the vertical window down a row: one row enters, one leaves
+    if (out_row > 0) {
+      if (row + radius < image_height) {
+        const Pixel *src = pixel_buffer_row(og_pixels, ++last_row) + lo;
+        for (size_t x = 0; x < span; ++x) {
+          r_sums[x] += src[x].r;
+          g_sums[x] += src[x].g;
+          b_sums[x] += src[x].b;
         }
       }
-
-      // Avoid division by zero
-      if (valid_neighbors == 0) {
-        fprintf(stderr,
-                "Warning: No valid neighbors at position [%zu,%zu]\n",
-                row,
-                col);
-        // Copy original pixel value as fallback
-        new_pixels[row][col - thread_data->start].r = og_pixels[row][col].r;
-        new_pixels[row][col - thread_data->start].g = og_pixels[row][col].g;
-        new_pixels[row][col - thread_data->start].b = og_pixels[row][col].b;
-        continue;
+      if (row > radius) {
+        const Pixel *src = pixel_buffer_row(og_pixels, first_row++) + lo;
+        for (size_t x = 0; x < span; ++x) {
+          r_sums[x] -= src[x].r;
+          g_sums[x] -= src[x].g;
+          b_sums[x] -= src[x].b;
+        }
       }
+    }
+
+    // Horizontal window of the row's first pixel
+    size_t first_col = thread_data->start > radius
+                         ? thread_data->start - radius
+                         : 0;
+    size_t last_col = thread_data->start + radius < image_width
+                        ? thread_data->start + radius
+                        : image_width - 1;
+    unsigned rSum = 0, gSum = 0, bSum = 0;
+    for (size_t x = first_col; x <= last_col; ++x) {
+      rSum += r_sums[x - lo];
+      gSum += g_sums[x - lo];
+      bSum += b_sums[x - lo];
+    }
 
-      // Store averaged values in thread's local array
-      new_pixels[row][col - thread_data->start].r =
-          clamp_to_pixel(rSum / valid_neighbors);
-      new_pixels[row][col - thread_data->start].g =
-          clamp_to_pixel(gSum / valid_neighbors);
-      new_pixels[row][col - thread_data->start].b =
-          clamp_to_pixel(bSum / valid_neighbors);
+    // the in-bounds part of the neighborhood is a rectangle, so the number
+    // of valid neighbors is rows * columns
+    const unsigned rows = (unsigned) (last_row - first_row + 1);
+    for (size_t col = thread_data->start;; ++col) {
+      const unsigned valid_neighbors =
+          rows * (unsigned) (last_col - first_col + 1);
+      new_pixels[col - thread_data->start].r =
+          (rgb_value) (rSum / valid_neighbors);
+      new_pixels[col - thread_data->start].g =
+          (rgb_value) (gSum / valid_neighbors);
+      new_pixels[col - thread_data->start].b =
+          (rgb_value) (bSum / valid_neighbors);
+      if (col == thread_data->end) break;
+
+      // slide the horizontal window right a column
+      if (col + 1 + radius < image_width) {
+        ++last_col;
+        rSum += r_sums[last_col - lo];
+        gSum += g_sums[last_col - lo];
+        bSum += b_sums[last_col - lo];
+      }
+      if (col >= radius) {
+        rSum -= r_sums[first_col - lo];
+        gSum -= g_sums[first_col - lo];
+        bSum -= b_sums[first_col - lo];
+        ++first_col;
+      }
     }
   }
 
-  pthread_exit(nullptr);
-}
+  FREE(column_sums);
+  return nullptr;
 
-/**
- * Converts the image to grayscale. If the scaling factor is less than 1 the new
- * image will be smaller, if it is larger than 1, the new image will be larger.
- *
- * @param  img: the image.
- * @param  factor: the scaling factor
- */
-// void image_apply_resize(Image *img, float factor) {
-//   // TODO: implement this
-// }
+fail:
+  // the region is left unfiltered; filter_task must not report it written
+  thread_data->status = EXIT_FAILURE;
+  return nullptr;
+}
 
-/**
- * Generates a random radius that is some fraction of the smallest image
- * dimension
- * @param min_dimension
- * @return
- */
-static int generate_radius(int32_t min_dimension) {
-  // Constraint: radius less than 1/6 the min dimension, at least 5
-  return (rand() % (min_dimension / 6)) + 5; // NOLINT(*-msc50-cpp)
+const Filter FILTER_BW = {
+  .apply = image_apply_t_bw,
+  .radius = 0,
+  .apply_planar = image_apply_t_bw_planar,
+  .apply_pixel = image_pixel_bw,
+};
+
+const Filter FILTER_CHEESE = {
+  .apply = image_apply_t_cheese,
+  .radius = 0,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+const Filter FILTER_BOXBLUR = {
+  .apply = image_apply_t_boxblur,
+  .radius = KERNEL_SIZE / 2,
+  .apply_planar = image_apply_t_boxblur_planar,
+  .apply_pixel = nullptr,
+};
+
+const Filter FILTER_COLORSHIFT = {
+  .apply = image_apply_t_colorshift,
+  .radius = 0,
+  .apply_planar = image_apply_t_colorshift_planar,
+  .apply_pixel = image_pixel_colorshift,
+};
+
+const Filter FILTER_BOXMEAN = {
+  .apply = image_apply_t_boxmean,
+  .radius = KERNEL_SIZE / 2,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+// the radius follows sigma: see gaussian_radius
+const Filter FILTER_GAUSSIAN = {
+  .apply = image_apply_t_gaussian,
+  .radius = 0,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+// the tables live in the pass: append it with filter_chain_append_lut
+const Filter FILTER_LUT = {
+  .apply = image_apply_t_lut,
+  .radius = 0,
+  .apply_planar = image_apply_t_lut_planar,
+  .apply_pixel = image_pixel_lut,
+};
+
+// the radius follows the kernel's size, and the kernel lives in the pass
+const Filter FILTER_CONVOLVE = {
+  .apply = image_apply_t_convolve,
+  .radius = 0,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+// the output size and resampled rows live outside the pass, set up by main
+const Filter FILTER_RESIZE = {
+  .apply = image_apply_t_resize,
+  .radius = 0,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+// the radius is given with the filter, and is read from the pass
+const Filter FILTER_MEDIAN = {
+  .apply = image_apply_t_median,
+  .radius = 0,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+// the tables follow the image's histogram, gathered into the pass by main
+const Filter FILTER_HISTOGRAM = {
+  .apply = image_apply_t_histogram,
+  .radius = 0,
+  .apply_planar = image_apply_t_lut_planar,
+  .apply_pixel = nullptr,
+};
+
+// the orientation is given with the filter, and is read from the pass; main
+// sizes the output image to match
+const Filter FILTER_ORIENT = {
+  .apply = image_apply_t_orient,
+  .radius = 0,
+  .apply_planar = nullptr,
+  .apply_pixel = nullptr,
+};
+
+void image_apply_resize(Image *img, float factor) {
+  const double width = round((double) img->width * factor);
+  const double height = round((double) img->height * factor);
+  const size_t out_width = width > 1 ? (size_t) width : 1;
+  const size_t out_height = height > 1 ? (size_t) height : 1;
+  ResizeImage resize;
+  PixelBuffer pixels;
+
+  if (!(factor > 0) || width > MAXIMUM_IMAGE_SIZE ||
+      height > MAXIMUM_IMAGE_SIZE) {
+    fprintf(stderr, "Invalid resize factor: %g\n", factor);
+    return;
+  }
+  if (resize_image_create(&resize, (size_t) img->width, (size_t) img->height,
+                          out_width, out_height, RESIZE_LANCZOS) !=
+      EXIT_SUCCESS) {
+    return;
+  }
+  if (pixel_buffer_create(&pixels, out_width, out_height, false) !=
+      EXIT_SUCCESS) {
+    resize_image_destroy(&resize);
+    return;
+  }
+  resize_image_build(nullptr, img, &resize);
+  image_apply_t_resize(&(ThreadData) {
+    .thread_pixels = pixels,
+    .width = out_width,
+    .height = out_height,
+    .og_image = img,
+    .resize = &resize,
+  });
+  resize_image_destroy(&resize);
+  pixel_buffer_destroy(&img->pixels);
+  img->pixels = pixels;
+  img->width = (int32_t) out_width;
+  img->height = (int32_t) out_height;
 }
 
-/**
- * Checks whether the pixel to look at is in the bounds of the image.
- * Used to prevent accessing memory that doesn't belong to the image array.
- * @param img: the image we're checking against
- * @param row: the row index of the pixel to check
- * @param col: the column index of the pixel to check
- * @return: 0 if the pixel is a valid pixel, 1 otherwise
- */
-static bool pixel_in_bounds(const Image *img, int row, int col) {
-  if (row < 0 || row >= (int) img->height || col < 0 || col >= (int) img->
-      width) {
-    return false;
+void image_apply_orient(Image *img, orientation orient) {
+  const bool swap = orientation_swaps_axes(orient);
+  const size_t out_width = (size_t) (swap ? img->height : img->width);
+  const size_t out_height = (size_t) (swap ? img->width : img->height);
+  const ChainPass pass = {.filter = FILTER_ORIENT, .orient = orient};
+  PixelBuffer pixels;
+
+  if (pixel_buffer_create(&pixels, out_width, out_height, false) !=
+      EXIT_SUCCESS) {
+    return;
   }
-  return true;
+  image_apply_t_orient(&(ThreadData) {
+    .thread_pixels = pixels,
+    .width = out_width,
+    .height = out_height,
+    .og_image = img,
+    .pass = &pass,
+  });
+  pixel_buffer_destroy(&img->pixels);
+  img->pixels = pixels;
+  img->width = (int32_t) out_width;
+  img->height = (int32_t) out_height;
 }
 
 /**
@@ -278,31 +514,8 @@ static rgb_value clamp_to_pixel(int value) {
   if (value <= 0) {
     return 0;
   }
-  return UCHAR_MAX;
-}
-
-static void flood_fill(Image *img,
-                       int h,
-                       int k,
-                       int radius,
-                       int x,
-                       int y) {
-  // if the pixel is out of bounds, return
-  if (!pixel_in_bounds(img, x, y)) return;
-  // get the distance between pixels
-  const double distance_from_center = sqrt((pow(x - h, 2)) + (pow(y - k, 2)));
-  if (distance_from_center > radius) return;
-  // if the pixel is already black, return to avoid infinite loop
-  if (img->pixel_array[x][y].r == 0 && img->pixel_array[x][y].g == 0 &&
-      img->pixel_array[x][y].b == 0)
-    return;
-  // if the pixel is within the radius, paint it black
-  img->pixel_array[x][y].r = 0;
-  img->pixel_array[x][y].g = 0;
-  img->pixel_array[x][y].b = 0;
-  // do the same to its 4 neighbors
-  flood_fill(img, h, k, radius, x - 1, y);
-  flood_fill(img, h, k, radius, x + 1, y);
-  flood_fill(img, h, k, radius, x, y - 1);
-  flood_fill(img, h, k, radius, x, y + 1);
+  if (value >= UCHAR_MAX) {
+    return UCHAR_MAX;
+  }
+  return (rgb_value) value;
 }
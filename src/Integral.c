@@ -0,0 +1,220 @@
+#include "../headers/Integral.h"
+
+#include <stdint.h>
+
+#include "../headers/macros.h"
+#include "../headers/Partition.h"
+
+/**
+ * A table build pass, split into bands of rows or stripes of columns.
+ */
+typedef struct {
+  const Image *image; // the image being summed
+  IntegralImage *table; // the table being built
+  size_t parts; // number of bands or stripes the pass is split into
+} IntegralJob;
+
+// helper functions
+static void rows_task(void *context, size_t index);
+
+static void columns_task(void *context, size_t index);
+
+static inline Pixel mean32(const IntegralImage *table, size_t row0,
+                           size_t col0, size_t row1, size_t col1);
+
+static inline Pixel mean64(const IntegralImage *table, size_t row0,
+                           size_t col0, size_t row1, size_t col1);
+
+int integral_image_create(IntegralImage *table, size_t width, size_t height) {
+  // the whole image's sum is the largest a rectangle can have
+  const bool wide = (uint64_t) width * height * UINT8_MAX > UINT32_MAX;
+  const size_t entry_size = wide ? sizeof(uint64_t) : sizeof(uint32_t);
+
+  *table = (IntegralImage) {0};
+  MALLOC(table->sums, entry_size * 3 * (width + 1) * (height + 1), fail);
+  table->wide = wide;
+  table->width = width;
+  table->height = height;
+  table->stride = 3 * (width + 1);
+  return EXIT_SUCCESS;
+
+fail:
+  return EXIT_FAILURE;
+}
+
+void integral_image_destroy(IntegralImage *table) {
+  FREE(table->sums);
+  *table = (IntegralImage) {0};
+}
+
+void integral_image_build(ThreadPool *pool, const Image *image,
+                          IntegralImage *table) {
+  IntegralJob job = {
+    .image = image,
+    .table = table,
+    .parts = thread_pool_size(pool),
+  };
+
+  table->height = (size_t) image->height;
+  thread_pool_run(pool, rows_task, &job, job.parts);
+  thread_pool_run(pool, columns_task, &job, job.parts);
+}
+
+Pixel integral_image_mean(const IntegralImage *table, size_t row, size_t col,
+                          size_t rows, size_t cols) {
+  return table->wide
+           ? mean64(table, row, col, row + rows, col + cols)
+           : mean32(table, row, col, row + rows, col + cols);
+}
+
+void *image_apply_t_boxmean(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const IntegralImage *table = thread_data->integral;
+  const size_t radius = thread_data->blur_radius;
+  const size_t image_width = table->width;
+  const size_t image_height = table->height;
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const size_t row = thread_data->row_start + i;
+    // the in-bounds part of the window, as in image_apply_t_boxblur
+    const size_t row0 = row > radius ? row - radius : 0;
+    const size_t row1 = row + radius + 1 < image_height
+                          ? row + radius + 1
+                          : image_height;
+    Pixel *dst = pixel_buffer_row(&thread_data->thread_pixels, i);
+    for (size_t j = 0; j < thread_data->width; ++j) {
+      const size_t col = thread_data->start + j;
+      const size_t col0 = col > radius ? col - radius : 0;
+      const size_t col1 = col + radius + 1 < image_width
+                            ? col + radius + 1
+                            : image_width;
+      dst[j] = table->wide ? mean64(table, row0, col0, row1, col1)
+                           : mean32(table, row0, col0, row1, col1);
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Task: write the running sums along each row of one row band into the
+ * table row below it. The first band also zeroes the table's top row.
+ * @param context the IntegralJob
+ * @param index the index of the row band
+ */
+static void rows_task(void *context, size_t index) {
+  const IntegralJob *job = (IntegralJob *) context;
+  const IntegralImage *table = job->table;
+  const size_t width = (size_t) job->image->width;
+  size_t first_row, rows;
+
+  partition_split((size_t) job->image->height, job->parts, index,
+                  &first_row, &rows);
+  for (size_t y = first_row; y < first_row + rows; ++y) {
+    const Pixel *src = pixel_buffer_row(&job->image->pixels, y);
+    uint64_t b = 0, g = 0, r = 0;
+    if (table->wide) {
+      uint64_t *dst = (uint64_t *) table->sums + (y + 1) * table->stride;
+      dst[0] = dst[1] = dst[2] = 0;
+      for (size_t x = 0; x < width; ++x) {
+        dst[3 * x + 3] = b += src[x].b;
+        dst[3 * x + 4] = g += src[x].g;
+        dst[3 * x + 5] = r += src[x].r;
+      }
+    } else {
+      uint32_t *dst = (uint32_t *) table->sums + (y + 1) * table->stride;
+      dst[0] = dst[1] = dst[2] = 0;
+      for (size_t x = 0; x < width; ++x) {
+        dst[3 * x + 3] = (uint32_t) (b += src[x].b);
+        dst[3 * x + 4] = (uint32_t) (g += src[x].g);
+        dst[3 * x + 5] = (uint32_t) (r += src[x].r);
+      }
+    }
+  }
+  if (index == 0) {
+    if (table->wide) {
+      for (size_t e = 0; e < table->stride; ++e) {
+        ((uint64_t *) table->sums)[e] = 0;
+      }
+    } else {
+      for (size_t e = 0; e < table->stride; ++e) {
+        ((uint32_t *) table->sums)[e] = 0;
+      }
+    }
+  }
+}
+
+/**
+ * Task: accumulate one stripe of table columns down the rows, turning the
+ * row sums into rectangle sums. Each table row of the stripe is contiguous.
+ * @param context the IntegralJob
+ * @param index the index of the column stripe
+ */
+static void columns_task(void *context, size_t index) {
+  const IntegralJob *job = (IntegralJob *) context;
+  const IntegralImage *table = job->table;
+  size_t first_col, cols;
+
+  // column 0 stays zero; split the image's columns into stripes
+  partition_split((size_t) job->image->width, job->parts, index,
+                  &first_col, &cols);
+  const size_t first = 3 * (first_col + 1);
+  const size_t last = first + 3 * cols;
+  for (size_t y = 2; y <= (size_t) job->image->height; ++y) {
+    if (table->wide) {
+      uint64_t *row = (uint64_t *) table->sums + y * table->stride;
+      const uint64_t *above = row - table->stride;
+      for (size_t e = first; e < last; ++e) row[e] += above[e];
+    } else {
+      uint32_t *row = (uint32_t *) table->sums + y * table->stride;
+      const uint32_t *above = row - table->stride;
+      for (size_t e = first; e < last; ++e) row[e] += above[e];
+    }
+  }
+}
+
+/**
+ * Returns the mean of the rectangle [row0, row1) x [col0, col1) from a table
+ * of 32-bit entries.
+ */
+static inline Pixel mean32(const IntegralImage *table, size_t row0,
+                           size_t col0, size_t row1, size_t col1) {
+  const uint32_t *sums = (const uint32_t *) table->sums;
+  const uint32_t *top_left = sums + row0 * table->stride + 3 * col0;
+  const uint32_t *top_right = sums + row0 * table->stride + 3 * col1;
+  const uint32_t *bottom_left = sums + row1 * table->stride + 3 * col0;
+  const uint32_t *bottom_right = sums + row1 * table->stride + 3 * col1;
+  const uint32_t count = (uint32_t) ((row1 - row0) * (col1 - col0));
+
+  // unsigned arithmetic: the result is exact even if a term wrapped
+  return (Pixel) {
+    .b = (rgb_value) ((bottom_right[0] - bottom_left[0] - top_right[0] +
+                       top_left[0]) / count),
+    .g = (rgb_value) ((bottom_right[1] - bottom_left[1] - top_right[1] +
+                       top_left[1]) / count),
+    .r = (rgb_value) ((bottom_right[2] - bottom_left[2] - top_right[2] +
+                       top_left[2]) / count),
+  };
+}
+
+/**
+ * Returns the mean of the rectangle [row0, row1) x [col0, col1) from a table
+ * of 64-bit entries.
+ */
+static inline Pixel mean64(const IntegralImage *table, size_t row0,
+                           size_t col0, size_t row1, size_t col1) {
+  const uint64_t *sums = (const uint64_t *) table->sums;
+  const uint64_t *top_left = sums + row0 * table->stride + 3 * col0;
+  const uint64_t *top_right = sums + row0 * table->stride + 3 * col1;
+  const uint64_t *bottom_left = sums + row1 * table->stride + 3 * col0;
+  const uint64_t *bottom_right = sums + row1 * table->stride + 3 * col1;
+  const uint64_t count = (uint64_t) ((row1 - row0) * (col1 - col0));
+
+  return (Pixel) {
+    .b = (rgb_value) ((bottom_right[0] - bottom_left[0] - top_right[0] +
+                       top_left[0]) / count),
+    .g = (rgb_value) ((bottom_right[1] - bottom_left[1] - top_right[1] +
+                       top_left[1]) / count),
+    .r = (rgb_value) ((bottom_right[2] - bottom_left[2] - top_right[2] +
+                       top_left[2]) / count),
+  };
+}
@@ -0,0 +1,90 @@
+#include "../headers/Lut.h"
+
+#include <math.h>
+
+// helper functions
+static rgb_value saturate(double value);
+
+void lut_identity(Lut *lut) {
+  for (int v = 0; v <= UCHAR_MAX; ++v) {
+    lut->b[v] = lut->g[v] = lut->r[v] = (rgb_value) v;
+  }
+}
+
+void lut_colorshift(Lut *lut, int r_shift, int g_shift, int b_shift) {
+  for (int v = 0; v <= UCHAR_MAX; ++v) {
+    lut->b[v] = saturate((double) v + b_shift);
+    lut->g[v] = saturate((double) v + g_shift);
+    lut->r[v] = saturate((double) v + r_shift);
+  }
+}
+
+void lut_contrast(Lut *lut, double factor) {
+  for (int v = 0; v <= UCHAR_MAX; ++v) {
+    lut->b[v] = lut->g[v] = lut->r[v] =
+        saturate(round((v - 128) * factor) + 128);
+  }
+}
+
+void lut_gamma(Lut *lut, double gamma) {
+  for (int v = 0; v <= UCHAR_MAX; ++v) {
+    lut->b[v] = lut->g[v] = lut->r[v] =
+        saturate(round(UCHAR_MAX * pow(v / (double) UCHAR_MAX, 1 / gamma)));
+  }
+}
+
+void lut_levels(Lut *lut, int black, int white) {
+  for (int v = 0; v <= UCHAR_MAX; ++v) {
+    lut->b[v] = lut->g[v] = lut->r[v] =
+        saturate(round((double) (v - black) * UCHAR_MAX / (white - black)));
+  }
+}
+
+void lut_compose(Lut *lut, const Lut *next) {
+  for (int v = 0; v <= UCHAR_MAX; ++v) {
+    lut->b[v] = next->b[lut->b[v]];
+    lut->g[v] = next->g[lut->g[v]];
+    lut->r[v] = next->r[lut->r[v]];
+  }
+}
+
+void *image_apply_t_lut(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const Lut *lut = &thread_data->pass->lut;
+
+  const PixelBuffer *read_pixels = &thread_data->og_image->pixels;
+  const PixelBuffer *write_pixels = &thread_data->thread_pixels;
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const Pixel *src = pixel_buffer_row(read_pixels, thread_data->row_start + i)
+                       + thread_data->start;
+    Pixel *dst = pixel_buffer_row(write_pixels, i);
+    for (size_t j = 0; j < thread_data->width; ++j) {
+      dst[j] = (Pixel) {
+        .b = lut->b[src[j].b],
+        .g = lut->g[src[j].g],
+        .r = lut->r[src[j].r],
+      };
+    }
+  }
+  return nullptr;
+}
+
+Pixel image_pixel_lut(Pixel pixel, const ThreadData *data) {
+  const Lut *lut = &data->pass->lut;
+
+  return (Pixel) {
+    .b = lut->b[pixel.b],
+    .g = lut->g[pixel.g],
+    .r = lut->r[pixel.r],
+  };
+}
+
+/**
+ * Clamps a value to an RGB value.
+ * @param value the value, already rounded
+ * @return the clamped value
+ */
+static rgb_value saturate(double value) {
+  return (rgb_value) (value < 0 ? 0 : value > UCHAR_MAX ? UCHAR_MAX : value);
+}
@@ -0,0 +1,324 @@
+#include "../headers/Median.h"
+
+#include <string.h>
+
+#include "../headers/macros.h"
+
+#define CHANNELS 3
+// fine bins per coarse bin, and coarse bins per histogram
+#define FINE_BINS 16
+#define COARSE_BINS ((UCHAR_MAX + 1) / FINE_BINS)
+
+// a column histogram counts at most the window's height
+static_assert(2 * MEDIAN_MAX_RADIUS + 1 <= UINT16_MAX,
+              "Column histogram counts must fit in 16 bits");
+
+/**
+ * Histograms of the window's rows, one per channel and column the thread's
+ * windows reach. The fine bins of one coarse bin lie together for
+ * consecutive columns, so catching a window's coarse bin up on a run of
+ * columns reads contiguous memory.
+ */
+typedef struct {
+  size_t span; // number of columns
+  uint16_t *coarse; // [channel][column][coarse bin]
+  uint16_t *fine; // [channel][coarse bin][column][fine bin]
+} ColumnHistograms;
+
+/**
+ * Histogram of one channel of the window. The coarse bins always count the
+ * window; a coarse bin's fine bins count the columns [first, last], which
+ * lag behind the window until the median falls in that bin.
+ */
+typedef struct {
+  uint32_t coarse[COARSE_BINS];
+  uint32_t fine[COARSE_BINS][FINE_BINS];
+  size_t first[COARSE_BINS];
+  size_t last[COARSE_BINS];
+  bool valid[COARSE_BINS]; // whether first and last hold
+} WindowHistogram;
+
+// helper functions
+static void columns_count_row(const ColumnHistograms *columns,
+                              const Pixel *row,
+                              bool add);
+
+static void window_reset(WindowHistogram *window,
+                         const ColumnHistograms *columns,
+                         size_t channel,
+                         size_t first,
+                         size_t last);
+
+static void window_count_column(WindowHistogram *window,
+                                const ColumnHistograms *columns,
+                                size_t channel,
+                                size_t column,
+                                bool add);
+
+static void window_update_fine(WindowHistogram *window,
+                               const ColumnHistograms *columns,
+                               size_t channel,
+                               size_t bin,
+                               size_t first,
+                               size_t last);
+
+static rgb_value window_median(WindowHistogram *window,
+                               const ColumnHistograms *columns,
+                               size_t channel,
+                               size_t first,
+                               size_t last,
+                               uint32_t rank);
+
+void *image_apply_t_median(void *data) {
+  ThreadData *thread_data = (ThreadData *) data;
+  const PixelBuffer *og_pixels = &thread_data->og_image->pixels;
+  const size_t radius = thread_data->pass->filter.radius;
+  const size_t image_width = (size_t) thread_data->og_image->width;
+  const size_t image_height = (size_t) thread_data->og_image->height;
+  // columns the thread's windows reach, clipped to the image
+  const size_t lo = thread_data->start > radius
+                      ? thread_data->start - radius
+                      : 0;
+  const size_t hi = thread_data->end + radius < image_width
+                      ? thread_data->end + radius
+                      : image_width - 1;
+  ColumnHistograms columns = {.span = hi - lo + 1};
+  WindowHistogram windows[CHANNELS];
+
+  if (thread_data->height == 0) return nullptr;
+  CALLOC(columns.coarse, CHANNELS * columns.span * COARSE_BINS,
+         sizeof(uint16_t), fail);
+  CALLOC(columns.fine, CHANNELS * columns.span * COARSE_BINS * FINE_BINS,
+         sizeof(uint16_t), fail);
+
+  // Vertical window of the first row: count its rows for every column
+  size_t first_row = thread_data->row_start > radius
+                       ? thread_data->row_start - radius
+                       : 0;
+  size_t last_row = thread_data->row_start + radius < image_height
+                      ? thread_data->row_start + radius
+                      : image_height - 1;
+  for (size_t y = first_row; y <= last_row; ++y) {
+    columns_count_row(&columns, pixel_buffer_row(og_pixels, y) + lo, true);
+  }
+
+  for (size_t out_row = 0; out_row < thread_data->height; ++out_row) {
+    const size_t row = thread_data->row_start + out_row;
+    rgb_value *dst = (rgb_value *) pixel_buffer_row(
+        &thread_data->thread_pixels, out_row);
+
+    // slide the vertical window down a row: one row enters, one leaves
+    if (out_row > 0) {
+      if (row + radius < image_height) {
+        columns_count_row(&columns,
+                          pixel_buffer_row(og_pixels, ++last_row) + lo,
+                          true);
+      }
+      if (row > radius) {
+        columns_count_row(&columns,
+                          pixel_buffer_row(og_pixels, first_row++) + lo,
+                          false);
+      }
+    }
+
+    // Horizontal window of the row's first pixel, in columns from lo
+    size_t first_col = thread_data->start > radius
+                         ? thread_data->start - radius - lo
+                         : 0;
+    size_t last_col = (thread_data->start + radius < image_width
+                         ? thread_data->start + radius
+                         : image_width - 1) - lo;
+    for (size_t c = 0; c < CHANNELS; ++c) {
+      window_reset(&windows[c], &columns, c, first_col, last_col);
+    }
+
+    // the in-bounds part of the window is a rectangle of rows * columns
+    const uint32_t rows = (uint32_t) (last_row - first_row + 1);
+    for (size_t col = thread_data->start;; ++col) {
+      const uint32_t count = rows * (uint32_t) (last_col - first_col + 1);
+      for (size_t c = 0; c < CHANNELS; ++c) {
+        dst[CHANNELS * (col - thread_data->start) + c] =
+            window_median(&windows[c], &columns, c, first_col, last_col,
+                          (count - 1) / 2);
+      }
+      if (col == thread_data->end) break;
+
+      // slide the horizontal window right a column
+      if (col + 1 + radius < image_width) {
+        ++last_col;
+        for (size_t c = 0; c < CHANNELS; ++c) {
+          window_count_column(&windows[c], &columns, c, last_col, true);
+        }
+      }
+      if (col >= radius) {
+        for (size_t c = 0; c < CHANNELS; ++c) {
+          window_count_column(&windows[c], &columns, c, first_col, false);
+        }
+        ++first_col;
+      }
+    }
+  }
+
+  FREE(columns.coarse);
+  FREE(columns.fine);
+  return nullptr;
+
+fail:
+  // the histograms are the only state, so without them nothing is filtered
+  FREE(columns.coarse);
+  thread_data->status = EXIT_FAILURE;
+  return nullptr;
+}
+
+/**
+ * Counts a row of pixels into, or out of, the column histograms.
+ * @param columns the column histograms
+ * @param row the pixel of the row in the first column
+ * @param add whether the row enters the window, rather than leaves it
+ */
+static void columns_count_row(const ColumnHistograms *columns,
+                              const Pixel *row,
+                              bool add) {
+  const rgb_value *bytes = (const rgb_value *) row;
+
+  for (size_t c = 0; c < CHANNELS; ++c) {
+    uint16_t *coarse = columns->coarse + c * columns->span * COARSE_BINS;
+    uint16_t *fine = columns->fine +
+                     c * COARSE_BINS * columns->span * FINE_BINS;
+    for (size_t x = 0; x < columns->span; ++x) {
+      const size_t value = bytes[CHANNELS * x + c];
+      const size_t bin = value / FINE_BINS;
+      uint16_t *coarse_count = &coarse[x * COARSE_BINS + bin];
+      uint16_t *fine_count = &fine[(bin * columns->span + x) * FINE_BINS +
+                                   value % FINE_BINS];
+      if (add) {
+        ++*coarse_count;
+        ++*fine_count;
+      } else {
+        --*coarse_count;
+        --*fine_count;
+      }
+    }
+  }
+}
+
+/**
+ * Starts the window of a row: counts its columns into the coarse bins, and
+ * leaves every fine bin to be counted when first needed.
+ * @param window the window's histogram of the channel
+ * @param columns the column histograms
+ * @param channel the channel
+ * @param first the window's first column
+ * @param last the window's last column
+ */
+static void window_reset(WindowHistogram *window,
+                         const ColumnHistograms *columns,
+                         size_t channel,
+                         size_t first,
+                         size_t last) {
+  memset(window->coarse, 0, sizeof(window->coarse));
+  memset(window->valid, 0, sizeof(window->valid));
+  for (size_t x = first; x <= last; ++x) {
+    window_count_column(window, columns, channel, x, true);
+  }
+}
+
+/**
+ * Counts a column into, or out of, the window's coarse bins.
+ * @param window the window's histogram of the channel
+ * @param columns the column histograms
+ * @param channel the channel
+ * @param column the column
+ * @param add whether the column enters the window, rather than leaves it
+ */
+static void window_count_column(WindowHistogram *window,
+                                const ColumnHistograms *columns,
+                                size_t channel,
+                                size_t column,
+                                bool add) {
+  const uint16_t *coarse = columns->coarse +
+                           (channel * columns->span + column) * COARSE_BINS;
+
+  if (add) {
+    for (size_t bin = 0; bin < COARSE_BINS; ++bin) {
+      window->coarse[bin] += coarse[bin];
+    }
+  } else {
+    for (size_t bin = 0; bin < COARSE_BINS; ++bin) {
+      window->coarse[bin] -= coarse[bin];
+    }
+  }
+}
+
+/**
+ * Brings the fine bins of one coarse bin up to date with the window: counts
+ * them afresh if the window has moved past the columns they count, and
+ * otherwise counts out the columns the window left and in those it reached.
+ * The window only moves right, so over a row this costs a column's bins per
+ * pixel at most.
+ * @param window the window's histogram of the channel
+ * @param columns the column histograms
+ * @param channel the channel
+ * @param bin the coarse bin
+ * @param first the window's first column
+ * @param last the window's last column
+ */
+static void window_update_fine(WindowHistogram *window,
+                               const ColumnHistograms *columns,
+                               size_t channel,
+                               size_t bin,
+                               size_t first,
+                               size_t last) {
+  uint32_t *fine = window->fine[bin];
+  const uint16_t *counts = columns->fine +
+                           (channel * COARSE_BINS + bin) * columns->span *
+                           FINE_BINS;
+  size_t from = first;
+
+  if (!window->valid[bin] || window->last[bin] < first) {
+    memset(fine, 0, sizeof(window->fine[bin]));
+  } else {
+    for (size_t x = window->first[bin]; x < first; ++x) {
+      for (size_t k = 0; k < FINE_BINS; ++k) {
+        fine[k] -= counts[x * FINE_BINS + k];
+      }
+    }
+    from = window->last[bin] + 1;
+  }
+  for (size_t x = from; x <= last; ++x) {
+    for (size_t k = 0; k < FINE_BINS; ++k) {
+      fine[k] += counts[x * FINE_BINS + k];
+    }
+  }
+  window->first[bin] = first;
+  window->last[bin] = last;
+  window->valid[bin] = true;
+}
+
+/**
+ * Finds the value of a given rank in the window: the coarse bin it falls in
+ * first, then its fine bin.
+ * @param window the window's histogram of the channel
+ * @param columns the column histograms
+ * @param channel the channel
+ * @param first the window's first column
+ * @param last the window's last column
+ * @param rank the rank, below the window's pixel count
+ * @return the value
+ */
+static rgb_value window_median(WindowHistogram *window,
+                               const ColumnHistograms *columns,
+                               size_t channel,
+                               size_t first,
+                               size_t last,
+                               uint32_t rank) {
+  size_t bin = 0, value = 0;
+  uint32_t below = 0;
+
+  while (below + window->coarse[bin] <= rank) below += window->coarse[bin++];
+  window_update_fine(window, columns, channel, bin, first, last);
+  while (below + window->fine[bin][value] <= rank) {
+    below += window->fine[bin][value++];
+  }
+  return (rgb_value) (bin * FINE_BINS + value);
+}
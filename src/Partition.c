@@ -0,0 +1,60 @@
+#include "../headers/Partition.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../headers/macros.h"
+
+void partition_split(size_t length, size_t parts, size_t index, size_t *first,
+                     size_t *size) {
+  const size_t base = length / parts;
+  const size_t extra = length % parts;
+
+  *first = index * base + (index < extra ? index : extra);
+  *size = base + (index < extra ? 1 : 0);
+}
+
+int partition_image(const Partition *partition, size_t width, size_t height,
+                    size_t parts, Region **regions, size_t *count) {
+  size_t grid_rows = 1, grid_cols = 1;
+
+  if (parts == 0) parts = 1;
+  switch (partition->mode) {
+    case PARTITION_ROWS:
+      grid_rows = parts < height ? parts : height;
+      break;
+    case PARTITION_COLUMNS:
+      grid_cols = parts < width ? parts : width;
+      break;
+    case PARTITION_TILES:
+      grid_rows = (height + partition->tile_height - 1) / partition->tile_height;
+      grid_cols = (width + partition->tile_width - 1) / partition->tile_width;
+      break;
+  }
+
+  MALLOC(*regions, sizeof(Region) * grid_rows * grid_cols, fail);
+  for (size_t r = 0; r < grid_rows; ++r) {
+    for (size_t c = 0; c < grid_cols; ++c) {
+      Region *region = &(*regions)[r * grid_cols + c];
+      if (partition->mode == PARTITION_TILES) {
+        // edge tiles are clipped to the area
+        region->row = r * partition->tile_height;
+        region->col = c * partition->tile_width;
+        region->height = height - region->row < partition->tile_height
+                           ? height - region->row
+                           : partition->tile_height;
+        region->width = width - region->col < partition->tile_width
+                          ? width - region->col
+                          : partition->tile_width;
+      } else {
+        partition_split(height, grid_rows, r, &region->row, &region->height);
+        partition_split(width, grid_cols, c, &region->col, &region->width);
+      }
+    }
+  }
+  *count = grid_rows * grid_cols;
+  return EXIT_SUCCESS;
+
+fail:
+  return EXIT_FAILURE;
+}
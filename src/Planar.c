@@ -0,0 +1,340 @@
+#include "../headers/Planar.h"
+
+#include <limits.h>
+#include <sys/errno.h>
+
+#include "../headers/macros.h"
+
+// helper functions
+static rgb_value *plane_row(const PlanarBuffer *planes,
+                            rgb_value *plane,
+                            size_t row);
+
+static rgb_value saturate(int value);
+
+static void add_plane_rows(const PlanarBuffer *planes, size_t row,
+                           size_t first, size_t count, unsigned *r_sums,
+                           unsigned *g_sums, unsigned *b_sums);
+
+static void subtract_plane_rows(const PlanarBuffer *planes, size_t row,
+                                size_t first, size_t count, unsigned *r_sums,
+                                unsigned *g_sums, unsigned *b_sums);
+
+/** Allocates an uninitialized planar buffer. The three planes share one
+ * cache-line-aligned allocation and every plane row starts on a cache line.
+ *
+ * @param  planes: the planar buffer to initialize.
+ * @param  width: Width of the buffer in pixels.
+ * @param  height: Height of the buffer in pixels.
+ * @param  huge_pages: Back a large buffer with huge pages where supported.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure.
+ */
+int planar_buffer_create(PlanarBuffer *planes, size_t width, size_t height,
+                         bool huge_pages) {
+  PixelBuffer block;
+  const size_t stride = (width + PIXEL_BUFFER_ALIGNMENT - 1) /
+                        PIXEL_BUFFER_ALIGNMENT * PIXEL_BUFFER_ALIGNMENT;
+
+  // borrow the aligned allocator: 3 planes of height rows of stride bytes
+  if (pixel_buffer_create(&block, stride, height, huge_pages) !=
+      EXIT_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  planes->r = (rgb_value *) block.data;
+  planes->g = planes->r + stride * height;
+  planes->b = planes->g + stride * height;
+  planes->stride = stride;
+  planes->width = width;
+  planes->height = height;
+  return EXIT_SUCCESS;
+}
+
+/** Frees a planar buffer.
+ *
+ * @param  planes: the planar buffer to free.
+ */
+void planar_buffer_destroy(PlanarBuffer *planes) {
+  FREE(planes->r);
+  *planes = (PlanarBuffer) {0};
+}
+
+/** Splits a run of packed pixels into three channel planes.
+ *
+ * @param  src: the packed pixels.
+ * @param  r: destination red plane run.
+ * @param  g: destination green plane run.
+ * @param  b: destination blue plane run.
+ * @param  count: number of pixels.
+ */
+void deinterleave_row(const Pixel *src, rgb_value *restrict r,
+                      rgb_value *restrict g, rgb_value *restrict b,
+                      size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    r[i] = src[i].r;
+    g[i] = src[i].g;
+    b[i] = src[i].b;
+  }
+}
+
+/** Merges three channel plane runs into packed pixels.
+ *
+ * @param  r: source red plane run.
+ * @param  g: source green plane run.
+ * @param  b: source blue plane run.
+ * @param  dst: the destination packed pixels.
+ * @param  count: number of pixels.
+ */
+void interleave_row(const rgb_value *r, const rgb_value *g, const rgb_value *b,
+                    Pixel *restrict dst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i].r = r[i];
+    dst[i].g = g[i];
+    dst[i].b = b[i];
+  }
+}
+
+void image_deinterleave_rows(const Image *image, const PlanarBuffer *planes,
+                             size_t first_row, size_t rows) {
+  for (size_t row = first_row; row < first_row + rows; ++row) {
+    deinterleave_row(pixel_buffer_row(&image->pixels, row),
+                     plane_row(planes, planes->r, row),
+                     plane_row(planes, planes->g, row),
+                     plane_row(planes, planes->b, row),
+                     (size_t) image->width);
+  }
+}
+
+void *image_apply_t_colorshift_planar(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const PlanarBuffer *in = thread_data->og_planes;
+  const PlanarBuffer *out = &thread_data->thread_planes;
+  const size_t width = thread_data->width;
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const size_t row = thread_data->row_start + i;
+    const rgb_value *r = plane_row(in, in->r, row) + thread_data->start;
+    const rgb_value *g = plane_row(in, in->g, row) + thread_data->start;
+    const rgb_value *b = plane_row(in, in->b, row) + thread_data->start;
+
+    // one unit-stride loop per channel
+    for (size_t j = 0; j < width; ++j) {
+      out->r[j] = saturate(r[j] + thread_data->rShift);
+    }
+    for (size_t j = 0; j < width; ++j) {
+      out->g[j] = saturate(g[j] + thread_data->gShift);
+    }
+    for (size_t j = 0; j < width; ++j) {
+      out->b[j] = saturate(b[j] + thread_data->bShift);
+    }
+    interleave_row(out->r, out->g, out->b,
+                   pixel_buffer_row(&thread_data->thread_pixels, i), width);
+  }
+  return nullptr;
+}
+
+void *image_apply_t_lut_planar(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const Lut *lut = &thread_data->pass->lut;
+  const PlanarBuffer *in = thread_data->og_planes;
+  const PlanarBuffer *out = &thread_data->thread_planes;
+  const size_t width = thread_data->width;
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const size_t row = thread_data->row_start + i;
+    const rgb_value *r = plane_row(in, in->r, row) + thread_data->start;
+    const rgb_value *g = plane_row(in, in->g, row) + thread_data->start;
+    const rgb_value *b = plane_row(in, in->b, row) + thread_data->start;
+
+    // one table per plane, so each loop gathers from a single 256-byte table
+    for (size_t j = 0; j < width; ++j) out->r[j] = lut->r[r[j]];
+    for (size_t j = 0; j < width; ++j) out->g[j] = lut->g[g[j]];
+    for (size_t j = 0; j < width; ++j) out->b[j] = lut->b[b[j]];
+    interleave_row(out->r, out->g, out->b,
+                   pixel_buffer_row(&thread_data->thread_pixels, i), width);
+  }
+  return nullptr;
+}
+
+void *image_apply_t_bw_planar(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const PlanarBuffer *in = thread_data->og_planes;
+  const PlanarBuffer *out = &thread_data->thread_planes;
+  const size_t width = thread_data->width;
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const size_t row = thread_data->row_start + i;
+    const rgb_value *r = plane_row(in, in->r, row) + thread_data->start;
+    const rgb_value *g = plane_row(in, in->g, row) + thread_data->start;
+    const rgb_value *b = plane_row(in, in->b, row) + thread_data->start;
+
+    for (size_t j = 0; j < width; ++j) {
+      out->r[j] = pixel_gray(r[j], g[j], b[j]);
+    }
+    interleave_row(out->r, out->r, out->r,
+                   pixel_buffer_row(&thread_data->thread_pixels, i), width);
+  }
+  return nullptr;
+}
+
+void *image_apply_t_boxblur_planar(void *data) {
+  ThreadData *thread_data = (ThreadData *) data;
+  const PlanarBuffer *in = thread_data->og_planes;
+  const PlanarBuffer *out = &thread_data->thread_planes;
+  const size_t radius = thread_data->blur_radius;
+  const size_t image_width = (size_t) thread_data->og_image->width;
+  const size_t image_height = (size_t) thread_data->og_image->height;
+  // columns the thread's neighborhoods reach, clipped to the image
+  const size_t lo = thread_data->start > radius
+                      ? thread_data->start - radius
+                      : 0;
+  const size_t hi = thread_data->end + radius < image_width
+                      ? thread_data->end + radius
+                      : image_width - 1;
+  const size_t span = hi - lo + 1;
+  unsigned *column_sums = nullptr;
+
+  if (thread_data->height == 0) return nullptr;
+  MALLOC(column_sums, sizeof(unsigned) * 3 * span, fail);
+  unsigned *r_sums = column_sums;
+  unsigned *g_sums = column_sums + span;
+  unsigned *b_sums = column_sums + 2 * span;
+
+  // vertical window of the first row: sum its rows for every column reached
+  size_t first_row = thread_data->row_start > radius
+                       ? thread_data->row_start - radius
+                       : 0;
+  size_t last_row = thread_data->row_start + radius < image_height
+                      ? thread_data->row_start + radius
+                      : image_height - 1;
+  for (size_t x = 0; x < span; ++x) {
+    r_sums[x] = g_sums[x] = b_sums[x] = 0;
+  }
+  for (size_t y = first_row; y <= last_row; ++y) {
+    add_plane_rows(in, y, lo, span, r_sums, g_sums, b_sums);
+  }
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const size_t row = thread_data->row_start + i;
+
+    // slide the vertical window down a row: one row enters, one leaves
+    if (i > 0) {
+      if (row + radius < image_height) {
+        add_plane_rows(in, ++last_row, lo, span, r_sums, g_sums, b_sums);
+      }
+      if (row > radius) {
+        subtract_plane_rows(in, first_row++, lo, span, r_sums, g_sums, b_sums);
+      }
+    }
+
+    // horizontal window: the in-bounds part of the neighborhood is a
+    // rectangle, so its size is rows * columns, as in image_apply_t_boxblur
+    size_t first_col = thread_data->start > radius
+                         ? thread_data->start - radius
+                         : 0;
+    size_t last_col = thread_data->start + radius < image_width
+                        ? thread_data->start + radius
+                        : image_width - 1;
+    unsigned r = 0, g = 0, b = 0;
+    for (size_t x = first_col; x <= last_col; ++x) {
+      r += r_sums[x - lo];
+      g += g_sums[x - lo];
+      b += b_sums[x - lo];
+    }
+    const unsigned rows = (unsigned) (last_row - first_row + 1);
+    for (size_t col = thread_data->start;; ++col) {
+      const unsigned count = rows * (unsigned) (last_col - first_col + 1);
+      out->r[col - thread_data->start] = (rgb_value) (r / count);
+      out->g[col - thread_data->start] = (rgb_value) (g / count);
+      out->b[col - thread_data->start] = (rgb_value) (b / count);
+      if (col == thread_data->end) break;
+
+      if (col + 1 + radius < image_width) {
+        ++last_col;
+        r += r_sums[last_col - lo];
+        g += g_sums[last_col - lo];
+        b += b_sums[last_col - lo];
+      }
+      if (col >= radius) {
+        r -= r_sums[first_col - lo];
+        g -= g_sums[first_col - lo];
+        b -= b_sums[first_col - lo];
+        ++first_col;
+      }
+    }
+    interleave_row(out->r, out->g, out->b,
+                   pixel_buffer_row(&thread_data->thread_pixels, i),
+                   thread_data->width);
+  }
+
+  FREE(column_sums);
+  return nullptr;
+
+fail:
+  // no planes were filtered, so none may be reported written
+  thread_data->status = EXIT_FAILURE;
+  return nullptr;
+}
+
+/**
+ * Adds a run of one row of each plane to per-column sums.
+ * @param planes the planar buffer
+ * @param row the row to add
+ * @param first the first column of the run
+ * @param count the number of columns in the run
+ * @param r_sums red column sums
+ * @param g_sums green column sums
+ * @param b_sums blue column sums
+ */
+static void add_plane_rows(const PlanarBuffer *planes, size_t row,
+                           size_t first, size_t count, unsigned *r_sums,
+                           unsigned *g_sums, unsigned *b_sums) {
+  const rgb_value *r = plane_row(planes, planes->r, row) + first;
+  const rgb_value *g = plane_row(planes, planes->g, row) + first;
+  const rgb_value *b = plane_row(planes, planes->b, row) + first;
+  for (size_t x = 0; x < count; ++x) r_sums[x] += r[x];
+  for (size_t x = 0; x < count; ++x) g_sums[x] += g[x];
+  for (size_t x = 0; x < count; ++x) b_sums[x] += b[x];
+}
+
+/**
+ * Subtracts a run of one row of each plane from per-column sums.
+ * @param planes the planar buffer
+ * @param row the row to subtract
+ * @param first the first column of the run
+ * @param count the number of columns in the run
+ * @param r_sums red column sums
+ * @param g_sums green column sums
+ * @param b_sums blue column sums
+ */
+static void subtract_plane_rows(const PlanarBuffer *planes, size_t row,
+                                size_t first, size_t count, unsigned *r_sums,
+                                unsigned *g_sums, unsigned *b_sums) {
+  const rgb_value *r = plane_row(planes, planes->r, row) + first;
+  const rgb_value *g = plane_row(planes, planes->g, row) + first;
+  const rgb_value *b = plane_row(planes, planes->b, row) + first;
+  for (size_t x = 0; x < count; ++x) r_sums[x] -= r[x];
+  for (size_t x = 0; x < count; ++x) g_sums[x] -= g[x];
+  for (size_t x = 0; x < count; ++x) b_sums[x] -= b[x];
+}
+
+/**
+ * Returns a pointer to the first byte of a row of one plane.
+ * @param planes the planar buffer the plane belongs to
+ * @param plane the plane (planes->r, planes->g or planes->b)
+ * @param row the row index
+ */
+static rgb_value *plane_row(const PlanarBuffer *planes,
+                            rgb_value *plane,
+                            size_t row) {
+  return plane + row * planes->stride;
+}
+
+/**
+ * Clamps the integer value to fit in an RGB value
+ * @param value the integer value to clamp
+ * @return the clamped value, an unsigned char
+ */
+static rgb_value saturate(int value) {
+  return (rgb_value) (value < 0 ? 0 : value > UCHAR_MAX ? UCHAR_MAX : value);
+}
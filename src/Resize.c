@@ -0,0 +1,258 @@
+#include "../headers/Resize.h"
+
+#include <math.h>
+
+#include "../headers/macros.h"
+#include "../headers/Partition.h"
+#include "../headers/Simd.h"
+
+// the lobes of the Lanczos filter
+#define LANCZOS_LOBES 3
+// the a of the Keys cubic filter
+#define BICUBIC_A (-0.5)
+// not every C library defines M_PI
+#define PI 3.14159265358979323846
+
+/**
+ * The horizontal pass of a resize, split into bands of input rows.
+ */
+typedef struct {
+  const Image *image; // the input image
+  ResizeImage *resize; // the resize being built
+  size_t parts; // number of bands the pass is split into
+} ResizeJob;
+
+// helper functions
+static double filter_support(resize_method method);
+
+static double filter_weight(resize_method method, double x);
+
+static int axis_create(ResizeAxis *axis, size_t in_size, size_t out_size,
+                       resize_method method);
+
+static void axis_destroy(ResizeAxis *axis);
+
+static rgb_value clamp_sum(int32_t sum);
+
+static void horizontal_task(void *context, size_t index);
+
+const char *resize_method_name(resize_method method) {
+  switch (method) {
+    case RESIZE_BILINEAR:
+      return "bilinear";
+    case RESIZE_BICUBIC:
+      return "bicubic";
+    default:
+      return "lanczos";
+  }
+}
+
+int resize_image_create(ResizeImage *resize, size_t in_width,
+                        size_t in_height, size_t out_width, size_t out_height,
+                        resize_method method) {
+  *resize = (ResizeImage) {0};
+  if (axis_create(&resize->columns, in_width, out_width, method) !=
+      EXIT_SUCCESS ||
+      axis_create(&resize->rows, in_height, out_height, method) !=
+      EXIT_SUCCESS ||
+      pixel_buffer_create(&resize->horizontal, out_width, in_height, false) !=
+      EXIT_SUCCESS) {
+    resize_image_destroy(resize);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+void resize_image_destroy(ResizeImage *resize) {
+  axis_destroy(&resize->columns);
+  axis_destroy(&resize->rows);
+  pixel_buffer_destroy(&resize->horizontal);
+}
+
+void resize_image_build(ThreadPool *pool, const Image *image,
+                        ResizeImage *resize) {
+  ResizeJob job = {
+    .image = image,
+    .resize = resize,
+    .parts = pool ? thread_pool_size(pool) : 1,
+  };
+
+  if (!pool) {
+    horizontal_task(&job, 0);
+    return;
+  }
+  thread_pool_run(pool, horizontal_task, &job, job.parts);
+}
+
+void *image_apply_t_resize(void *data) {
+  const ThreadData *thread_data = (ThreadData *) data;
+  const ResizeImage *resize = thread_data->resize;
+  const ResizeAxis *rows = &resize->rows;
+
+  for (size_t i = 0; i < thread_data->height; ++i) {
+    const size_t y = thread_data->row_start + i;
+    const Pixel *src = pixel_buffer_row(&resize->horizontal, rows->first[y]) +
+                       thread_data->start;
+    simd_resample_row((const rgb_value *) src,
+                      resize->horizontal.stride,
+                      rows->weights + y * rows->taps,
+                      rows->count[y],
+                      (rgb_value *) pixel_buffer_row(
+                          &thread_data->thread_pixels, i),
+                      sizeof(Pixel) * thread_data->width);
+  }
+  return nullptr;
+}
+
+/**
+ * Returns how far from its center a filter reaches, in input pixels when
+ * enlarging.
+ * @param method the filter
+ * @return the support
+ */
+static double filter_support(resize_method method) {
+  switch (method) {
+    case RESIZE_BILINEAR:
+      return 1;
+    case RESIZE_BICUBIC:
+      return 2;
+    default:
+      return LANCZOS_LOBES;
+  }
+}
+
+/**
+ * Evaluates a filter.
+ * @param method the filter
+ * @param x the distance from the center
+ * @return the unnormalized weight at x
+ */
+static double filter_weight(resize_method method, double x) {
+  x = fabs(x);
+  switch (method) {
+    case RESIZE_BILINEAR:
+      return x < 1 ? 1 - x : 0;
+    case RESIZE_BICUBIC:
+      if (x < 1) return ((BICUBIC_A + 2) * x - (BICUBIC_A + 3)) * x * x + 1;
+      if (x < 2) return (((x - 5) * x + 8) * x - 4) * BICUBIC_A;
+      return 0;
+    default:
+      if (x == 0) return 1;
+      if (x >= LANCZOS_LOBES) return 0;
+      return LANCZOS_LOBES * sin(PI * x) * sin(PI * x / LANCZOS_LOBES) /
+             (PI * PI * x * x);
+  }
+}
+
+/**
+ * Computes the weight table of one axis.
+ * @param axis the table to initialize
+ * @param in_size the number of input positions
+ * @param out_size the number of output positions
+ * @param method the filter
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure
+ */
+static int axis_create(ResizeAxis *axis, size_t in_size, size_t out_size,
+                       resize_method method) {
+  const double scale = (double) in_size / (double) out_size;
+  // shrinking widens the filter, so it averages what it drops
+  const double filter_scale = scale > 1 ? scale : 1;
+  const double support = filter_support(method) * filter_scale;
+  const size_t span = 2 * (size_t) ceil(support) + 1;
+  double *kernel = nullptr;
+
+  *axis = (ResizeAxis) {0};
+  axis->taps = span < in_size ? span : in_size;
+  MALLOC(axis->first, sizeof(size_t) * out_size, fail);
+  MALLOC(axis->count, sizeof(size_t) * out_size, fail);
+  CALLOC(axis->weights, out_size * axis->taps, sizeof(int32_t), fail);
+  MALLOC(kernel, sizeof(double) * axis->taps, fail);
+
+  for (size_t i = 0; i < out_size; ++i) {
+    // where the output position's center falls in the input
+    const double center = ((double) i + 0.5) * scale;
+    const double low = floor(center - support + 0.5);
+    const double high = floor(center + support + 0.5);
+    const size_t first = low > 0 ? (size_t) low : 0;
+    size_t end = high < (double) in_size ? (size_t) high : in_size;
+    double total = 0;
+
+    if (end - first > axis->taps) end = first + axis->taps;
+    for (size_t k = 0; k < end - first; ++k) {
+      kernel[k] = filter_weight(method,
+                                ((double) (first + k) - center + 0.5) /
+                                filter_scale);
+      total += kernel[k];
+    }
+    axis->first[i] = first;
+    axis->count[i] = end - first;
+    for (size_t k = 0; k < end - first; ++k) {
+      axis->weights[i * axis->taps + k] = (int32_t) lround(
+          kernel[k] / total * (1 << RESAMPLE_SHIFT));
+    }
+  }
+  FREE(kernel);
+  return EXIT_SUCCESS;
+
+fail:
+  FREE(kernel);
+  axis_destroy(axis);
+  return EXIT_FAILURE;
+}
+
+/**
+ * Frees the weight table of one axis.
+ * @param axis the table
+ */
+static void axis_destroy(ResizeAxis *axis) {
+  FREE(axis->first);
+  FREE(axis->count);
+  FREE(axis->weights);
+  *axis = (ResizeAxis) {0};
+}
+
+/**
+ * Rounds a weighted sum of channel values and clamps it to an RGB value.
+ * @param sum the sum, with RESAMPLE_SHIFT fraction bits
+ * @return the channel value
+ */
+static rgb_value clamp_sum(int32_t sum) {
+  sum += 1 << (RESAMPLE_SHIFT - 1);
+  sum = sum < 0 ? 0 : sum >> RESAMPLE_SHIFT;
+  return (rgb_value) (sum > UCHAR_MAX ? UCHAR_MAX : sum);
+}
+
+/**
+ * Task: resample the rows of one band of the input to the output width.
+ * @param context the ResizeJob
+ * @param index the index of the band
+ */
+static void horizontal_task(void *context, size_t index) {
+  const ResizeJob *job = (ResizeJob *) context;
+  const ResizeImage *resize = job->resize;
+  const ResizeAxis *columns = &resize->columns;
+  size_t first_row, rows;
+
+  partition_split((size_t) job->image->height, job->parts, index, &first_row,
+                  &rows);
+  for (size_t y = first_row; y < first_row + rows; ++y) {
+    const Pixel *src = pixel_buffer_row(&job->image->pixels, y);
+    Pixel *dst = pixel_buffer_row(&resize->horizontal, y);
+    for (size_t x = 0; x < resize->horizontal.width; ++x) {
+      const Pixel *in = src + columns->first[x];
+      const int32_t *weights = columns->weights + x * columns->taps;
+      // one sum per channel: independent, so their additions overlap
+      int32_t b = 0, g = 0, r = 0;
+      for (size_t k = 0; k < columns->count[x]; ++k) {
+        b += weights[k] * in[k].b;
+        g += weights[k] * in[k].g;
+        r += weights[k] * in[k].r;
+      }
+      dst[x] = (Pixel) {
+        .b = clamp_sum(b),
+        .g = clamp_sum(g),
+        .r = clamp_sum(r),
+      };
+    }
+  }
+}
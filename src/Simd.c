@@ -0,0 +1,614 @@
+#include "../headers/Simd.h"
+
+#include <limits.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// A vector kernel converts a prefix of a run, a whole number of its chunks,
+// and returns how many pixels it did; the scalar code does the rest.
+typedef size_t (*bw_kernel)(const Pixel *src, Pixel *dst, size_t count);
+
+// add and sub hold the per-byte amounts to add and subtract, repeating every
+// 3 bytes; at most one of the two is non-zero for a channel
+typedef size_t (*colorshift_kernel)(const Pixel *src, Pixel *dst,
+                                    size_t count, const uint8_t *add,
+                                    const uint8_t *sub);
+
+typedef size_t (*resample_kernel)(const rgb_value *src, size_t stride,
+                                  const int32_t *weights, size_t taps,
+                                  rgb_value *dst, size_t count);
+
+// bytes of add/sub patterns: 3 vectors of the widest kernel
+#define SHIFT_PATTERN_SIZE 192
+
+// added to a weighted sum so that shifting it rounds to nearest
+#define RESAMPLE_ROUND (1 << (RESAMPLE_SHIFT - 1))
+
+static bw_kernel bw_vector = nullptr;
+static colorshift_kernel colorshift_vector = nullptr;
+static resample_kernel resample_vector = nullptr;
+
+// helper functions
+static rgb_value shift_channel(rgb_value value, int shift);
+
+#ifdef SIMD_X86
+
+// gather_masks[c][k] moves channel c (b, g, r) of the 16 pixels held in the
+// 48 bytes of vectors 0-2 from vector k into bytes 0-15; 0x80 zeroes a byte
+static const uint8_t GATHER_MASKS[3][3][16] = {
+  {
+    {0, 3, 6, 9, 12, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+     0x80},
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 2, 5, 8, 11, 14, 0x80, 0x80, 0x80,
+     0x80, 0x80},
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 1, 4, 7,
+     10, 13},
+  },
+  {
+    {1, 4, 7, 10, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+     0x80, 0x80},
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0, 3, 6, 9, 12, 15, 0x80, 0x80, 0x80, 0x80,
+     0x80},
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 2, 5, 8,
+     11, 14},
+  },
+  {
+    {2, 5, 8, 11, 14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+     0x80, 0x80},
+    {0x80, 0x80, 0x80, 0x80, 0x80, 1, 4, 7, 10, 13, 0x80, 0x80, 0x80, 0x80,
+     0x80, 0x80},
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 3, 6, 9,
+     12, 15},
+  },
+};
+
+// spread_masks[k] fills vector k of 16 pixels with gray values 0-15, each
+// repeated for the 3 channels of its pixel
+static const uint8_t SPREAD_MASKS[3][16] = {
+  {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5},
+  {5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10},
+  {10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15},
+};
+
+// pixel_gray in fixed point: n = 299 r + 587 g + 114 b is at most 255000,
+// and n / 1000 = (n / 8) / 125. No 32-bit multiplier divides every such n by
+// 1000 exactly, but ((n >> 3) * 33555) >> 22 does, without overflowing.
+#define GRAY_WEIGHTS_RG (299 | 587 << 16)
+#define GRAY_WEIGHT_B 114
+#define GRAY_PRE_SHIFT 3
+#define GRAY_DIVIDE_MULTIPLIER 33555
+#define GRAY_DIVIDE_SHIFT 22
+
+/*
+ * The gray kernels keep 16 pixels (48 bytes) per 128-bit lane: vector k of a
+ * chunk holds bytes 16k to 16k + 15 of each lane's pixels. Shuffles, unpacks
+ * and packs all work within lanes, so every width runs the same steps.
+ */
+
+__attribute__((target("ssse3,sse4.1")))
+static size_t bw_sse41(const Pixel *src, Pixel *dst, size_t count) {
+  const uint8_t *in = (const uint8_t *) src;
+  uint8_t *out = (uint8_t *) dst;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights_rg = _mm_set1_epi32(GRAY_WEIGHTS_RG);
+  const __m128i weight_b = _mm_set1_epi32(GRAY_WEIGHT_B);
+  const __m128i multiplier = _mm_set1_epi32(GRAY_DIVIDE_MULTIPLIER);
+  __m128i gather[3][3], spread[3];
+  size_t done = 0;
+
+  for (int c = 0; c < 3; ++c) {
+    for (int k = 0; k < 3; ++k) {
+      gather[c][k] = _mm_loadu_si128((const __m128i *) GATHER_MASKS[c][k]);
+    }
+    spread[c] = _mm_loadu_si128((const __m128i *) SPREAD_MASKS[c]);
+  }
+
+  for (; done + 16 <= count; done += 16, in += 48, out += 48) {
+    const __m128i v[3] = {
+      _mm_loadu_si128((const __m128i *) in),
+      _mm_loadu_si128((const __m128i *) (in + 16)),
+      _mm_loadu_si128((const __m128i *) (in + 32)),
+    };
+    __m128i channel[3];
+    for (int c = 0; c < 3; ++c) {
+      channel[c] = _mm_or_si128(
+          _mm_or_si128(_mm_shuffle_epi8(v[0], gather[c][0]),
+                       _mm_shuffle_epi8(v[1], gather[c][1])),
+          _mm_shuffle_epi8(v[2], gather[c][2]));
+    }
+    // (r, g) pairs and b, 4 pixels per vector of 32-bit sums
+    const __m128i rg_lo = _mm_unpacklo_epi8(channel[2], channel[1]);
+    const __m128i rg_hi = _mm_unpackhi_epi8(channel[2], channel[1]);
+    const __m128i b_lo = _mm_unpacklo_epi8(channel[0], zero);
+    const __m128i b_hi = _mm_unpackhi_epi8(channel[0], zero);
+    __m128i sum[4] = {
+      _mm_madd_epi16(_mm_unpacklo_epi8(rg_lo, zero), weights_rg),
+      _mm_madd_epi16(_mm_unpackhi_epi8(rg_lo, zero), weights_rg),
+      _mm_madd_epi16(_mm_unpacklo_epi8(rg_hi, zero), weights_rg),
+      _mm_madd_epi16(_mm_unpackhi_epi8(rg_hi, zero), weights_rg),
+    };
+    sum[0] = _mm_add_epi32(sum[0], _mm_madd_epi16(
+                               _mm_unpacklo_epi16(b_lo, zero), weight_b));
+    sum[1] = _mm_add_epi32(sum[1], _mm_madd_epi16(
+                               _mm_unpackhi_epi16(b_lo, zero), weight_b));
+    sum[2] = _mm_add_epi32(sum[2], _mm_madd_epi16(
+                               _mm_unpacklo_epi16(b_hi, zero), weight_b));
+    sum[3] = _mm_add_epi32(sum[3], _mm_madd_epi16(
+                               _mm_unpackhi_epi16(b_hi, zero), weight_b));
+    for (int i = 0; i < 4; ++i) {
+      const __m128i eighths = _mm_srli_epi32(sum[i], GRAY_PRE_SHIFT);
+      sum[i] = _mm_srli_epi32(_mm_mullo_epi32(eighths, multiplier),
+                              GRAY_DIVIDE_SHIFT);
+    }
+    const __m128i gray = _mm_packus_epi16(_mm_packus_epi32(sum[0], sum[1]),
+                                          _mm_packus_epi32(sum[2], sum[3]));
+    for (int k = 0; k < 3; ++k) {
+      _mm_storeu_si128((__m128i *) (out + 16 * k),
+                       _mm_shuffle_epi8(gray, spread[k]));
+    }
+  }
+  return done;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load_lanes_avx2(const uint8_t *lane) {
+  return _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) lane)),
+      _mm_loadu_si128((const __m128i *) (lane + 48)),
+      1);
+}
+
+__attribute__((target("avx2")))
+static inline void store_lanes_avx2(uint8_t *lane, __m256i v) {
+  _mm_storeu_si128((__m128i *) lane, _mm256_castsi256_si128(v));
+  _mm_storeu_si128((__m128i *) (lane + 48), _mm256_extracti128_si256(v, 1));
+}
+
+__attribute__((target("avx2")))
+static size_t bw_avx2(const Pixel *src, Pixel *dst, size_t count) {
+  const uint8_t *in = (const uint8_t *) src;
+  uint8_t *out = (uint8_t *) dst;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i weights_rg = _mm256_set1_epi32(GRAY_WEIGHTS_RG);
+  const __m256i weight_b = _mm256_set1_epi32(GRAY_WEIGHT_B);
+  const __m256i multiplier = _mm256_set1_epi32(GRAY_DIVIDE_MULTIPLIER);
+  __m256i gather[3][3], spread[3];
+  size_t done = 0;
+
+  for (int c = 0; c < 3; ++c) {
+    for (int k = 0; k < 3; ++k) {
+      gather[c][k] = _mm256_broadcastsi128_si256(
+          _mm_loadu_si128((const __m128i *) GATHER_MASKS[c][k]));
+    }
+    spread[c] = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *) SPREAD_MASKS[c]));
+  }
+
+  for (; done + 32 <= count; done += 32, in += 96, out += 96) {
+    const __m256i v[3] = {
+      load_lanes_avx2(in),
+      load_lanes_avx2(in + 16),
+      load_lanes_avx2(in + 32),
+    };
+    __m256i channel[3];
+    for (int c = 0; c < 3; ++c) {
+      channel[c] = _mm256_or_si256(
+          _mm256_or_si256(_mm256_shuffle_epi8(v[0], gather[c][0]),
+                          _mm256_shuffle_epi8(v[1], gather[c][1])),
+          _mm256_shuffle_epi8(v[2], gather[c][2]));
+    }
+    const __m256i rg_lo = _mm256_unpacklo_epi8(channel[2], channel[1]);
+    const __m256i rg_hi = _mm256_unpackhi_epi8(channel[2], channel[1]);
+    const __m256i b_lo = _mm256_unpacklo_epi8(channel[0], zero);
+    const __m256i b_hi = _mm256_unpackhi_epi8(channel[0], zero);
+    __m256i sum[4] = {
+      _mm256_madd_epi16(_mm256_unpacklo_epi8(rg_lo, zero), weights_rg),
+      _mm256_madd_epi16(_mm256_unpackhi_epi8(rg_lo, zero), weights_rg),
+      _mm256_madd_epi16(_mm256_unpacklo_epi8(rg_hi, zero), weights_rg),
+      _mm256_madd_epi16(_mm256_unpackhi_epi8(rg_hi, zero), weights_rg),
+    };
+    sum[0] = _mm256_add_epi32(sum[0], _mm256_madd_epi16(
+                                  _mm256_unpacklo_epi16(b_lo, zero), weight_b));
+    sum[1] = _mm256_add_epi32(sum[1], _mm256_madd_epi16(
+                                  _mm256_unpackhi_epi16(b_lo, zero), weight_b));
+    sum[2] = _mm256_add_epi32(sum[2], _mm256_madd_epi16(
+                                  _mm256_unpacklo_epi16(b_hi, zero), weight_b));
+    sum[3] = _mm256_add_epi32(sum[3], _mm256_madd_epi16(
+                                  _mm256_unpackhi_epi16(b_hi, zero), weight_b));
+    for (int i = 0; i < 4; ++i) {
+      const __m256i eighths = _mm256_srli_epi32(sum[i], GRAY_PRE_SHIFT);
+      sum[i] = _mm256_srli_epi32(_mm256_mullo_epi32(eighths, multiplier),
+                                 GRAY_DIVIDE_SHIFT);
+    }
+    const __m256i gray = _mm256_packus_epi16(
+        _mm256_packus_epi32(sum[0], sum[1]),
+        _mm256_packus_epi32(sum[2], sum[3]));
+    for (int k = 0; k < 3; ++k) {
+      store_lanes_avx2(out + 16 * k, _mm256_shuffle_epi8(gray, spread[k]));
+    }
+  }
+  return done;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i load_lanes_avx512(const uint8_t *lane) {
+  __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *) lane));
+  v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) (lane + 48)), 1);
+  v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) (lane + 96)), 2);
+  return _mm512_inserti32x4(v,
+                            _mm_loadu_si128((const __m128i *) (lane + 144)),
+                            3);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline void store_lanes_avx512(uint8_t *lane, __m512i v) {
+  _mm_storeu_si128((__m128i *) lane, _mm512_castsi512_si128(v));
+  _mm_storeu_si128((__m128i *) (lane + 48), _mm512_extracti32x4_epi32(v, 1));
+  _mm_storeu_si128((__m128i *) (lane + 96), _mm512_extracti32x4_epi32(v, 2));
+  _mm_storeu_si128((__m128i *) (lane + 144), _mm512_extracti32x4_epi32(v, 3));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t bw_avx512(const Pixel *src, Pixel *dst, size_t count) {
+  const uint8_t *in = (const uint8_t *) src;
+  uint8_t *out = (uint8_t *) dst;
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i weights_rg = _mm512_set1_epi32(GRAY_WEIGHTS_RG);
+  const __m512i weight_b = _mm512_set1_epi32(GRAY_WEIGHT_B);
+  const __m512i multiplier = _mm512_set1_epi32(GRAY_DIVIDE_MULTIPLIER);
+  __m512i gather[3][3], spread[3];
+  size_t done = 0;
+
+  for (int c = 0; c < 3; ++c) {
+    for (int k = 0; k < 3; ++k) {
+      gather[c][k] = _mm512_broadcast_i32x4(
+          _mm_loadu_si128((const __m128i *) GATHER_MASKS[c][k]));
+    }
+    spread[c] = _mm512_broadcast_i32x4(
+        _mm_loadu_si128((const __m128i *) SPREAD_MASKS[c]));
+  }
+
+  for (; done + 64 <= count; done += 64, in += 192, out += 192) {
+    const __m512i v[3] = {
+      load_lanes_avx512(in),
+      load_lanes_avx512(in + 16),
+      load_lanes_avx512(in + 32),
+    };
+    __m512i channel[3];
+    for (int c = 0; c < 3; ++c) {
+      channel[c] = _mm512_or_si512(
+          _mm512_or_si512(_mm512_shuffle_epi8(v[0], gather[c][0]),
+                          _mm512_shuffle_epi8(v[1], gather[c][1])),
+          _mm512_shuffle_epi8(v[2], gather[c][2]));
+    }
+    const __m512i rg_lo = _mm512_unpacklo_epi8(channel[2], channel[1]);
+    const __m512i rg_hi = _mm512_unpackhi_epi8(channel[2], channel[1]);
+    const __m512i b_lo = _mm512_unpacklo_epi8(channel[0], zero);
+    const __m512i b_hi = _mm512_unpackhi_epi8(channel[0], zero);
+    __m512i sum[4] = {
+      _mm512_madd_epi16(_mm512_unpacklo_epi8(rg_lo, zero), weights_rg),
+      _mm512_madd_epi16(_mm512_unpackhi_epi8(rg_lo, zero), weights_rg),
+      _mm512_madd_epi16(_mm512_unpacklo_epi8(rg_hi, zero), weights_rg),
+      _mm512_madd_epi16(_mm512_unpackhi_epi8(rg_hi, zero), weights_rg),
+    };
+    sum[0] = _mm512_add_epi32(sum[0], _mm512_madd_epi16(
+                                  _mm512_unpacklo_epi16(b_lo, zero), weight_b));
+    sum[1] = _mm512_add_epi32(sum[1], _mm512_madd_epi16(
+                                  _mm512_unpackhi_epi16(b_lo, zero), weight_b));
+    sum[2] = _mm512_add_epi32(sum[2], _mm512_madd_epi16(
+                                  _mm512_unpacklo_epi16(b_hi, zero), weight_b));
+    sum[3] = _mm512_add_epi32(sum[3], _mm512_madd_epi16(
+                                  _mm512_unpackhi_epi16(b_hi, zero), weight_b));
+    for (int i = 0; i < 4; ++i) {
+      const __m512i eighths = _mm512_srli_epi32(sum[i], GRAY_PRE_SHIFT);
+      sum[i] = _mm512_srli_epi32(_mm512_mullo_epi32(eighths, multiplier),
+                                 GRAY_DIVIDE_SHIFT);
+    }
+    const __m512i gray = _mm512_packus_epi16(
+        _mm512_packus_epi32(sum[0], sum[1]),
+        _mm512_packus_epi32(sum[2], sum[3]));
+    for (int k = 0; k < 3; ++k) {
+      store_lanes_avx512(out + 16 * k, _mm512_shuffle_epi8(gray, spread[k]));
+    }
+  }
+  return done;
+}
+
+/*
+ * The color shift kernels work on the bytes as they are: a chunk of 3
+ * vectors is a whole number of pixels, so the add and sub patterns line up
+ * with the channels the same way in every chunk.
+ */
+
+__attribute__((target("sse4.1")))
+static size_t colorshift_sse41(const Pixel *src, Pixel *dst, size_t count,
+                               const uint8_t *add, const uint8_t *sub) {
+  const uint8_t *in = (const uint8_t *) src;
+  uint8_t *out = (uint8_t *) dst;
+  __m128i add_v[3], sub_v[3];
+  size_t done = 0;
+
+  for (int k = 0; k < 3; ++k) {
+    add_v[k] = _mm_loadu_si128((const __m128i *) (add + 16 * k));
+    sub_v[k] = _mm_loadu_si128((const __m128i *) (sub + 16 * k));
+  }
+  for (; done + 16 <= count; done += 16, in += 48, out += 48) {
+    for (int k = 0; k < 3; ++k) {
+      const __m128i v = _mm_loadu_si128((const __m128i *) (in + 16 * k));
+      _mm_storeu_si128((__m128i *) (out + 16 * k),
+                       _mm_subs_epu8(_mm_adds_epu8(v, add_v[k]), sub_v[k]));
+    }
+  }
+  return done;
+}
+
+__attribute__((target("avx2")))
+static size_t colorshift_avx2(const Pixel *src, Pixel *dst, size_t count,
+                              const uint8_t *add, const uint8_t *sub) {
+  const uint8_t *in = (const uint8_t *) src;
+  uint8_t *out = (uint8_t *) dst;
+  __m256i add_v[3], sub_v[3];
+  size_t done = 0;
+
+  for (int k = 0; k < 3; ++k) {
+    add_v[k] = _mm256_loadu_si256((const __m256i *) (add + 32 * k));
+    sub_v[k] = _mm256_loadu_si256((const __m256i *) (sub + 32 * k));
+  }
+  for (; done + 32 <= count; done += 32, in += 96, out += 96) {
+    for (int k = 0; k < 3; ++k) {
+      const __m256i v = _mm256_loadu_si256((const __m256i *) (in + 32 * k));
+      _mm256_storeu_si256((__m256i *) (out + 32 * k),
+                          _mm256_subs_epu8(_mm256_adds_epu8(v, add_v[k]),
+                                           sub_v[k]));
+    }
+  }
+  return done;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t colorshift_avx512(const Pixel *src, Pixel *dst, size_t count,
+                                const uint8_t *add, const uint8_t *sub) {
+  const uint8_t *in = (const uint8_t *) src;
+  uint8_t *out = (uint8_t *) dst;
+  __m512i add_v[3], sub_v[3];
+  size_t done = 0;
+
+  for (int k = 0; k < 3; ++k) {
+    add_v[k] = _mm512_loadu_si512(add + 64 * k);
+    sub_v[k] = _mm512_loadu_si512(sub + 64 * k);
+  }
+  for (; done + 64 <= count; done += 64, in += 192, out += 192) {
+    for (int k = 0; k < 3; ++k) {
+      const __m512i v = _mm512_loadu_si512(in + 64 * k);
+      _mm512_storeu_si512(out + 64 * k,
+                          _mm512_subs_epu8(_mm512_adds_epu8(v, add_v[k]),
+                                           sub_v[k]));
+    }
+  }
+  return done;
+}
+
+/*
+ * The resample kernels widen each byte to 32 bits before weighting it;
+ * signed then unsigned saturating packs clamp the shifted sums to 0..255.
+ */
+
+__attribute__((target("sse4.1")))
+static size_t resample_sse41(const rgb_value *src, size_t stride,
+                             const int32_t *weights, size_t taps,
+                             rgb_value *dst, size_t count) {
+  size_t done = 0;
+
+  for (; done + 16 <= count; done += 16) {
+    __m128i sum[4];
+    for (int k = 0; k < 4; ++k) sum[k] = _mm_set1_epi32(RESAMPLE_ROUND);
+    for (size_t t = 0; t < taps; ++t) {
+      const __m128i weight = _mm_set1_epi32(weights[t]);
+      const __m128i v =
+          _mm_loadu_si128((const __m128i *) (src + t * stride + done));
+      sum[0] = _mm_add_epi32(sum[0],
+                             _mm_mullo_epi32(_mm_cvtepu8_epi32(v), weight));
+      sum[1] = _mm_add_epi32(sum[1], _mm_mullo_epi32(
+          _mm_cvtepu8_epi32(_mm_srli_si128(v, 4)), weight));
+      sum[2] = _mm_add_epi32(sum[2], _mm_mullo_epi32(
+          _mm_cvtepu8_epi32(_mm_srli_si128(v, 8)), weight));
+      sum[3] = _mm_add_epi32(sum[3], _mm_mullo_epi32(
+          _mm_cvtepu8_epi32(_mm_srli_si128(v, 12)), weight));
+    }
+    for (int k = 0; k < 4; ++k) {
+      sum[k] = _mm_srai_epi32(sum[k], RESAMPLE_SHIFT);
+    }
+    _mm_storeu_si128((__m128i *) (dst + done),
+                     _mm_packus_epi16(_mm_packs_epi32(sum[0], sum[1]),
+                                      _mm_packs_epi32(sum[2], sum[3])));
+  }
+  return done;
+}
+
+__attribute__((target("avx2")))
+static size_t resample_avx2(const rgb_value *src, size_t stride,
+                            const int32_t *weights, size_t taps,
+                            rgb_value *dst, size_t count) {
+  // the packs interleave the 128-bit lanes' 4-byte groups; this restores
+  // their order
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  size_t done = 0;
+
+  for (; done + 32 <= count; done += 32) {
+    __m256i sum[4];
+    for (int k = 0; k < 4; ++k) sum[k] = _mm256_set1_epi32(RESAMPLE_ROUND);
+    for (size_t t = 0; t < taps; ++t) {
+      const __m256i weight = _mm256_set1_epi32(weights[t]);
+      const rgb_value *row = src + t * stride + done;
+      const __m128i low = _mm_loadu_si128((const __m128i *) row);
+      const __m128i high = _mm_loadu_si128((const __m128i *) (row + 16));
+      sum[0] = _mm256_add_epi32(sum[0], _mm256_mullo_epi32(
+          _mm256_cvtepu8_epi32(low), weight));
+      sum[1] = _mm256_add_epi32(sum[1], _mm256_mullo_epi32(
+          _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)), weight));
+      sum[2] = _mm256_add_epi32(sum[2], _mm256_mullo_epi32(
+          _mm256_cvtepu8_epi32(high), weight));
+      sum[3] = _mm256_add_epi32(sum[3], _mm256_mullo_epi32(
+          _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)), weight));
+    }
+    for (int k = 0; k < 4; ++k) {
+      sum[k] = _mm256_srai_epi32(sum[k], RESAMPLE_SHIFT);
+    }
+    const __m256i packed =
+        _mm256_packus_epi16(_mm256_packs_epi32(sum[0], sum[1]),
+                            _mm256_packs_epi32(sum[2], sum[3]));
+    _mm256_storeu_si256((__m256i *) (dst + done),
+                        _mm256_permutevar8x32_epi32(packed, order));
+  }
+  return done;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t resample_avx512(const rgb_value *src, size_t stride,
+                              const int32_t *weights, size_t taps,
+                              rgb_value *dst, size_t count) {
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i max = _mm512_set1_epi32(UCHAR_MAX);
+  size_t done = 0;
+
+  for (; done + 64 <= count; done += 64) {
+    __m512i sum[4];
+    for (int k = 0; k < 4; ++k) sum[k] = _mm512_set1_epi32(RESAMPLE_ROUND);
+    for (size_t t = 0; t < taps; ++t) {
+      const __m512i weight = _mm512_set1_epi32(weights[t]);
+      const rgb_value *row = src + t * stride + done;
+      for (int k = 0; k < 4; ++k) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (row + 16 * k));
+        sum[k] = _mm512_add_epi32(sum[k], _mm512_mullo_epi32(
+            _mm512_cvtepu8_epi32(v), weight));
+      }
+    }
+    // clamp, then narrow each 32-bit sum to its low byte
+    for (int k = 0; k < 4; ++k) {
+      const __m512i clamped = _mm512_min_epi32(
+          _mm512_max_epi32(_mm512_srai_epi32(sum[k], RESAMPLE_SHIFT), zero),
+          max);
+      _mm_storeu_si128((__m128i *) (dst + done + 16 * k),
+                       _mm512_cvtepi32_epi8(clamped));
+    }
+  }
+  return done;
+}
+
+#endif
+
+simd_level simd_select(simd_level cap) {
+  simd_level level = SIMD_SCALAR;
+
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (cap >= SIMD_AVX512 && __builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512bw")) {
+    level = SIMD_AVX512;
+    bw_vector = bw_avx512;
+    colorshift_vector = colorshift_avx512;
+    resample_vector = resample_avx512;
+  } else if (cap >= SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+    level = SIMD_AVX2;
+    bw_vector = bw_avx2;
+    colorshift_vector = colorshift_avx2;
+    resample_vector = resample_avx2;
+  } else if (cap >= SIMD_SSE41 && __builtin_cpu_supports("ssse3") &&
+             __builtin_cpu_supports("sse4.1")) {
+    level = SIMD_SSE41;
+    bw_vector = bw_sse41;
+    colorshift_vector = colorshift_sse41;
+    resample_vector = resample_sse41;
+  } else {
+    bw_vector = nullptr;
+    colorshift_vector = nullptr;
+    resample_vector = nullptr;
+  }
+#else
+  (void) cap;
+#endif
+  return level;
+}
+
+const char *simd_level_name(simd_level level) {
+  switch (level) {
+    case SIMD_SSE41:
+      return "sse4.1";
+    case SIMD_AVX2:
+      return "avx2";
+    case SIMD_AVX512:
+      return "avx512";
+    default:
+      return "scalar";
+  }
+}
+
+void simd_bw_row(const Pixel *src, Pixel *dst, size_t count) {
+  const size_t done = bw_vector ? bw_vector(src, dst, count) : 0;
+
+  for (size_t j = done; j < count; ++j) {
+    const rgb_value gray = pixel_gray(src[j].r, src[j].g, src[j].b);
+    dst[j] = (Pixel) {.b = gray, .g = gray, .r = gray};
+  }
+}
+
+void simd_colorshift_row(const Pixel *src, Pixel *dst, size_t count,
+                         int r_shift, int g_shift, int b_shift) {
+  size_t done = 0;
+
+  if (colorshift_vector) {
+    const int shifts[3] = {b_shift, g_shift, r_shift};
+    uint8_t add[SHIFT_PATTERN_SIZE], sub[SHIFT_PATTERN_SIZE];
+    // a shift beyond +-255 saturates every value, just as one of 255 does
+    for (size_t i = 0; i < SHIFT_PATTERN_SIZE; ++i) {
+      const int shift = shifts[i % 3];
+      add[i] = (uint8_t) (shift > 0 ? shift < UCHAR_MAX ? shift : UCHAR_MAX
+                                    : 0);
+      sub[i] = (uint8_t) (shift < 0 ? shift > -UCHAR_MAX ? -shift : UCHAR_MAX
+                                    : 0);
+    }
+    done = colorshift_vector(src, dst, count, add, sub);
+  }
+  for (size_t j = done; j < count; ++j) {
+    dst[j] = (Pixel) {
+      .b = shift_channel(src[j].b, b_shift),
+      .g = shift_channel(src[j].g, g_shift),
+      .r = shift_channel(src[j].r, r_shift),
+    };
+  }
+}
+
+void simd_resample_row(const rgb_value *src, size_t stride,
+                       const int32_t *weights, size_t taps, rgb_value *dst,
+                       size_t count) {
+  const size_t done = resample_vector
+                        ? resample_vector(src, stride, weights, taps, dst,
+                                          count)
+                        : 0;
+
+  for (size_t i = done; i < count; ++i) {
+    int32_t sum = RESAMPLE_ROUND;
+    for (size_t t = 0; t < taps; ++t) {
+      sum += weights[t] * src[t * stride + i];
+    }
+    // a negative sum clamps to 0 before it is shifted
+    sum = sum < 0 ? 0 : sum >> RESAMPLE_SHIFT;
+    dst[i] = (rgb_value) (sum > UCHAR_MAX ? UCHAR_MAX : sum);
+  }
+}
+
+/**
+ * Adds a shift to a channel value, clamped to an RGB value.
+ * @param value the channel value
+ * @param shift the shift
+ * @return the shifted value
+ */
+static rgb_value shift_channel(rgb_value value, int shift) {
+  const int shifted = value + shift;
+  return (rgb_value) (shifted < 0 ? 0 : shifted > UCHAR_MAX ? UCHAR_MAX
+                                                            : shifted);
+}
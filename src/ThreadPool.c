@@ -0,0 +1,470 @@
+#define _GNU_SOURCE // pthread_attr_setaffinity_np, cpu_set_t
+#include "../headers/ThreadPool.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../headers/macros.h"
+
+typedef struct {
+  ThreadPool *pool;
+  pthread_t thread;
+  size_t index;
+  pthread_mutex_t lock; // guards head and tail
+  size_t head, tail; // the worker's deque: task indices [head, tail)
+  size_t first, last; // the run of indices the worker started the batch with
+  double busy_seconds; // time spent running tasks this batch
+  double static_seconds; // time the run it started with took, wherever run
+  size_t steals; // steals this batch
+} Worker;
+
+struct ThreadPool {
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready; // a batch was posted, or the pool is stopping
+  pthread_cond_t work_done; // the last worker finished the batch
+  Worker *workers;
+  size_t thread_count;
+  pool_task task; // the current batch
+  void *context;
+  double *task_seconds; // run time of each task of the batch, or nullptr
+  size_t generation; // incremented for every batch
+  size_t working; // workers that have not finished the current batch
+  bool stopping;
+  ThreadPoolStats stats;
+};
+
+// index of the worker the calling thread is, 0 outside the pool
+static _Thread_local size_t current_worker;
+
+// helper functions
+static void *pool_worker(void *data);
+
+static void run_batch(Worker *worker);
+
+static bool take_own(Worker *worker, size_t *index);
+
+static bool steal(Worker *thief);
+
+static double now_seconds(void);
+
+static bool pin_attr(pthread_attr_t *attr, pool_affinity affinity,
+                     size_t index, size_t thread_count);
+
+static size_t cgroup_cpu_limit(void);
+
+static bool read_numbers(const char *path, long long *first, long long *second);
+
+size_t thread_pool_default_size(void) {
+  const long online = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t size = online > 0 ? (size_t) online : 1;
+  const size_t limit = cgroup_cpu_limit();
+
+  if (limit > 0 && limit < size) {
+    size = limit;
+  }
+  return size;
+}
+
+ThreadPool *thread_pool_create(size_t thread_count, pool_affinity affinity) {
+  ThreadPool *pool = nullptr;
+
+  CALLOC(pool, 1, sizeof(ThreadPool), fail);
+  CALLOC(pool->workers, thread_count, sizeof(Worker), fail_workers);
+  if (pthread_mutex_init(&pool->lock, nullptr) != 0) goto fail_lock;
+  if (pthread_cond_init(&pool->work_ready, nullptr) != 0) goto fail_ready;
+  if (pthread_cond_init(&pool->work_done, nullptr) != 0) goto fail_done;
+
+  for (; pool->thread_count < thread_count; ++pool->thread_count) {
+    Worker *worker = &pool->workers[pool->thread_count];
+    worker->pool = pool;
+    worker->index = pool->thread_count;
+    if (pthread_mutex_init(&worker->lock, nullptr) != 0) {
+      perror("Error creating thread pool.");
+      thread_pool_destroy(&pool);
+      return nullptr;
+    }
+    // a pinned worker's stack is allocated on its own node, too
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (affinity != POOL_AFFINITY_NONE &&
+        !pin_attr(&attr, affinity, worker->index, thread_count)) {
+      fprintf(stderr, "Could not pin worker %zu, leaving it unpinned.\n",
+              worker->index);
+    }
+    const int created = pthread_create(&worker->thread,
+                                       &attr,
+                                       pool_worker,
+                                       worker);
+    pthread_attr_destroy(&attr);
+    if (created != 0) {
+      perror("Error creating thread.");
+      pthread_mutex_destroy(&worker->lock);
+      thread_pool_destroy(&pool);
+      return nullptr;
+    }
+  }
+  return pool;
+
+fail_done:
+  pthread_cond_destroy(&pool->work_ready);
+fail_ready:
+  pthread_mutex_destroy(&pool->lock);
+fail_lock:
+  FREE(pool->workers);
+fail_workers:
+  FREE(pool);
+fail:
+  perror("Error creating thread pool.");
+  return nullptr;
+}
+
+size_t thread_pool_size(const ThreadPool *pool) {
+  return pool->thread_count;
+}
+
+void thread_pool_run(ThreadPool *pool, pool_task task, void *context,
+                     size_t count) {
+  const size_t base = count / pool->thread_count;
+  const size_t extra = count % pool->thread_count;
+  size_t next = 0;
+
+  if (count == 0) return;
+
+  // deal the indices out in contiguous runs, so neighboring tasks (and the
+  // memory they touch) stay on one worker unless it falls behind
+  for (size_t i = 0; i < pool->thread_count; ++i) {
+    Worker *worker = &pool->workers[i];
+    worker->first = worker->head = next;
+    next += base + (i < extra ? 1 : 0);
+    worker->last = worker->tail = next;
+    worker->busy_seconds = 0;
+    worker->steals = 0;
+  }
+  // the statistics are best effort: without the buffer only they are lost
+  if ((pool->task_seconds = malloc(sizeof(double) * count)) == nullptr) {
+    perror("Error allocating task timings, scheduling statistics dropped.");
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->task = task;
+  pool->context = context;
+  pool->working = pool->thread_count;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->work_ready);
+  while (pool->working > 0) {
+    pthread_cond_wait(&pool->work_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  ++pool->stats.batches;
+  pool->stats.tasks += count;
+  for (size_t i = 0; i < pool->thread_count; ++i) {
+    pool->stats.steals += pool->workers[i].steals;
+  }
+  if (!pool->task_seconds) return;
+
+  // Both idle times come from the measured task times alone: the makespan
+  // of the busiest worker, with and without the steals, less each worker's
+  // share. Wake-up latency is in neither, so they can be compared.
+  double makespan = 0, static_makespan = 0;
+  for (size_t i = 0; i < pool->thread_count; ++i) {
+    Worker *worker = &pool->workers[i];
+    // what the worker would have run without stealing
+    worker->static_seconds = 0;
+    for (size_t t = worker->first; t < worker->last; ++t) {
+      worker->static_seconds += pool->task_seconds[t];
+    }
+    if (worker->busy_seconds > makespan) {
+      makespan = worker->busy_seconds;
+    }
+    if (worker->static_seconds > static_makespan) {
+      static_makespan = worker->static_seconds;
+    }
+  }
+  for (size_t i = 0; i < pool->thread_count; ++i) {
+    pool->stats.idle_seconds += makespan - pool->workers[i].busy_seconds;
+    pool->stats.static_idle_seconds +=
+        static_makespan - pool->workers[i].static_seconds;
+  }
+  FREE(pool->task_seconds);
+}
+
+size_t thread_pool_worker_index(void) {
+  return current_worker;
+}
+
+void thread_pool_get_stats(const ThreadPool *pool, ThreadPoolStats *stats) {
+  *stats = pool->stats;
+}
+
+void thread_pool_destroy(ThreadPool **pool) {
+  if (!*pool) return;
+
+  pthread_mutex_lock(&(*pool)->lock);
+  (*pool)->stopping = true;
+  pthread_cond_broadcast(&(*pool)->work_ready);
+  pthread_mutex_unlock(&(*pool)->lock);
+
+  for (size_t i = 0; i < (*pool)->thread_count; ++i) {
+    pthread_join((*pool)->workers[i].thread, nullptr);
+    pthread_mutex_destroy(&(*pool)->workers[i].lock);
+  }
+  pthread_cond_destroy(&(*pool)->work_done);
+  pthread_cond_destroy(&(*pool)->work_ready);
+  pthread_mutex_destroy(&(*pool)->lock);
+  FREE((*pool)->workers);
+  FREE(*pool);
+}
+
+/**
+ * Worker thread: runs its share of every batch posted, until the pool
+ * stops.
+ * @param data the worker
+ */
+static void *pool_worker(void *data) {
+  Worker *worker = (Worker *) data;
+  ThreadPool *pool = worker->pool;
+  size_t seen = 0;
+
+  current_worker = worker->index;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stopping && pool->generation == seen) {
+      pthread_cond_wait(&pool->work_ready, &pool->lock);
+    }
+    if (pool->stopping) break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    run_batch(worker);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->working == 0) {
+      pthread_cond_signal(&pool->work_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return nullptr;
+}
+
+/**
+ * Runs the worker's deque to empty, then steals from the other workers
+ * until every deque is empty.
+ * @param worker the worker
+ */
+static void run_batch(Worker *worker) {
+  ThreadPool *pool = worker->pool;
+  size_t index;
+
+  do {
+    while (take_own(worker, &index)) {
+      const double started = now_seconds();
+      pool->task(pool->context, index);
+      const double seconds = now_seconds() - started;
+      worker->busy_seconds += seconds;
+      if (pool->task_seconds) {
+        pool->task_seconds[index] = seconds;
+      }
+    }
+  } while (steal(worker));
+}
+
+/**
+ * Takes the front index of the worker's own deque.
+ * @param worker the worker
+ * @param index where to store the index
+ * @return false if the deque is empty
+ */
+static bool take_own(Worker *worker, size_t *index) {
+  bool taken = false;
+
+  pthread_mutex_lock(&worker->lock);
+  if (worker->head < worker->tail) {
+    *index = worker->head++;
+    taken = true;
+  }
+  pthread_mutex_unlock(&worker->lock);
+  return taken;
+}
+
+/**
+ * Moves the back half of the first non-empty deque of another worker into
+ * the thief's own (empty) deque.
+ * @param thief the worker looking for work
+ * @return false if every deque is empty
+ */
+static bool steal(Worker *thief) {
+  ThreadPool *pool = thief->pool;
+
+  for (size_t i = 1; i < pool->thread_count; ++i) {
+    Worker *victim = &pool->workers[(thief->index + i) % pool->thread_count];
+    size_t head = 0, tail = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    if (victim->head < victim->tail) {
+      tail = victim->tail;
+      victim->tail -= (victim->tail - victim->head + 1) / 2;
+      head = victim->tail;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (head < tail) {
+      pthread_mutex_lock(&thief->lock);
+      thief->head = head;
+      thief->tail = tail;
+      pthread_mutex_unlock(&thief->lock);
+      ++thief->steals;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Returns a monotonic time in seconds.
+ */
+static double now_seconds(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+#define MAX_NUMA_NODES 64
+
+/**
+ * Reads a kernel CPU list such as "0-3,8-11" into a CPU set.
+ * @param path the file to read
+ * @param set where to store the CPUs
+ * @return whether the file could be read
+ */
+static bool read_cpu_list(const char *path, cpu_set_t *set) {
+  FILE *file = fopen(path, "r");
+  int first, last;
+
+  CPU_ZERO(set);
+  if (!file) return false;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    if (fscanf(file, "-%d", &last) < 0) break;
+    for (int cpu = first < 0 ? 0 : first; cpu <= last && cpu < CPU_SETSIZE;
+         ++cpu) {
+      CPU_SET((size_t) cpu, set);
+    }
+    if (fgetc(file) != ',') break;
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * Sets the CPU affinity of a thread attribute for a worker: either the
+ * index-th allowed core, or every allowed core of the node that the
+ * worker's block of indices falls on.
+ * @param attr the attribute of the thread to be created
+ * @param affinity where to pin the workers
+ * @param index the worker's index
+ * @param thread_count the number of workers
+ * @return whether the attribute was set
+ */
+static bool pin_attr(pthread_attr_t *attr, pool_affinity affinity,
+                     size_t index, size_t thread_count) {
+  cpu_set_t allowed, set;
+  size_t cpus[CPU_SETSIZE];
+  size_t cpu_count = 0;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return false;
+  CPU_ZERO(&set);
+
+  if (affinity == POOL_AFFINITY_CORES) {
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed)) cpus[cpu_count++] = cpu;
+    }
+    if (cpu_count == 0) return false;
+    CPU_SET(cpus[index % cpu_count], &set);
+  } else {
+    // the allowed part of every node, in node order
+    cpu_set_t nodes[MAX_NUMA_NODES];
+    size_t node_count = 0;
+    for (int node = 0; node < MAX_NUMA_NODES; ++node) {
+      char path[64];
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/node/node%d/cpulist", node);
+      if (!read_cpu_list(path, &nodes[node_count])) continue;
+      CPU_AND(&nodes[node_count], &nodes[node_count], &allowed);
+      if (CPU_COUNT(&nodes[node_count]) > 0) ++node_count;
+    }
+    if (node_count == 0) {
+      // no NUMA information: one node holding every allowed core
+      nodes[node_count++] = allowed;
+    }
+    set = nodes[index * node_count / thread_count];
+  }
+  return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0;
+}
+#else
+static bool pin_attr(pthread_attr_t *attr, pool_affinity affinity,
+                     size_t index, size_t thread_count) {
+  (void) attr;
+  (void) affinity;
+  (void) index;
+  (void) thread_count;
+  return false;
+}
+#endif
+
+/**
+ * Returns the CPU quota of the process's cgroup rounded up to whole CPUs,
+ * or 0 if there is none. Both cgroup v2 (cpu.max) and v1 (cfs quota) are
+ * read.
+ */
+static size_t cgroup_cpu_limit(void) {
+  long long quota, period;
+
+  if (!read_numbers("/sys/fs/cgroup/cpu.max", &quota, &period) &&
+      !(read_numbers("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", &quota, nullptr) &&
+        read_numbers("/sys/fs/cgroup/cpu/cpu.cfs_period_us", &period,
+                     nullptr))) {
+    return 0;
+  }
+  // "max" (v2) and -1 (v1) mean no quota
+  if (quota <= 0 || period <= 0) {
+    return 0;
+  }
+  return (size_t) ((quota + period - 1) / period);
+}
+
+/**
+ * Reads one or two whitespace-separated integers from a file. A word that
+ * is not a number, such as "max", reads as -1.
+ * @param path the file to read
+ * @param first where to store the first number
+ * @param second where to store the second number, nullptr to read one
+ * @return whether the file could be read
+ */
+static bool read_numbers(const char *path, long long *first,
+                         long long *second) {
+  FILE *file = fopen(path, "r");
+  char word[32];
+  char *end;
+
+  if (!file) return false;
+  if (fscanf(file, "%31s", word) != 1) {
+    fclose(file);
+    return false;
+  }
+  *first = strtoll(word, &end, 10);
+  if (*end != '\0') {
+    *first = -1;
+  }
+  const bool ok = !second || fscanf(file, "%lld", second) == 1;
+  fclose(file);
+  return ok;
+}